@@ -0,0 +1,98 @@
+// Compares what a large batch costs the main thread with object-per-event delivery and with binary batches.
+//
+// Build the addon and compile the JS first, then run from the repository root:
+//   npm run compile && node bench/callback.js [eventCount] [eventsPerCallback]
+//
+// Each mode watches a fresh directory while a child process creates eventCount files in it, delivered in callbacks
+// of eventsPerCallback events. A 1ms heartbeat measures how long the event loop was blocked building each batch
+// before the callback ran, and the callback then reads every field of every event the way a consumer would.
+const { spawn } = require('child_process');
+const fs = require('fs');
+const fse = require('fs-extra');
+const os = require('os');
+const path = require('path');
+const nsfw = require('../lib/src');
+
+const EVENT_COUNT = parseInt(process.argv[2], 10) || 100000;
+const EVENTS_PER_CALLBACK = parseInt(process.argv[3], 10) || 10000;
+const DEBOUNCE_MS = 5000;
+
+// keeps the reads in the callback from being optimized away
+let checksum = 0;
+
+function milliseconds(since) {
+  const [seconds, nanoseconds] = process.hrtime(since);
+  return seconds * 1e3 + nanoseconds / 1e6;
+}
+
+function run(binary) {
+  const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'nsfw-bench-'));
+  let lastTick = process.hrtime();
+  let callbacks = 0;
+  let received = 0;
+  let blockedMS = 0;
+  let readMS = 0;
+  let finish;
+  const finished = new Promise(resolve => {
+    finish = resolve;
+  });
+
+  const heartbeat = setInterval(() => {
+    lastTick = process.hrtime();
+  }, 1);
+
+  function handleEvents(events) {
+    // the native side built the chunk during this same turn, right before calling us
+    blockedMS += milliseconds(lastTick);
+
+    const start = process.hrtime();
+    events.forEach(event => {
+      checksum += event.action + event.directory.length + (event.file || event.newFile).length;
+    });
+    readMS += milliseconds(start);
+
+    // the next chunk may follow before the heartbeat gets another turn
+    lastTick = process.hrtime();
+
+    callbacks += 1;
+    received += events.length;
+    if (received >= EVENT_COUNT) {
+      finish();
+    }
+  }
+
+  let watcher;
+  return nsfw(dir, handleEvents, { debounceMS: DEBOUNCE_MS, maxCallbackEvents: EVENTS_PER_CALLBACK, binary })
+    .then(w => {
+      watcher = w;
+      return watcher.start();
+    })
+    .then(() => {
+      const createFiles = `
+        const fs = require('fs');
+        for (let i = 0; i < ${EVENT_COUNT}; ++i) {
+          fs.closeSync(fs.openSync(require('path').join(${JSON.stringify(dir)}, 'file' + i), 'w'));
+        }
+      `;
+      spawn(process.execPath, ['-e', createFiles], { stdio: 'inherit' });
+      return finished;
+    })
+    .then(() => watcher.stop())
+    .then(() => {
+      clearInterval(heartbeat);
+      fse.removeSync(dir);
+      console.log(
+        `${binary ? 'binary ' : 'objects'}  ${received} events in ${callbacks} callbacks  ` +
+        `loop blocked ${blockedMS.toFixed(1)} ms (${(blockedMS / callbacks).toFixed(2)} ms per callback)  ` +
+        `read ${readMS.toFixed(1)} ms  total ${(blockedMS + readMS).toFixed(1)} ms`
+      );
+    });
+}
+
+run(false)
+  .then(() => run(true))
+  .then(() => console.log(`checksum ${checksum}`))
+  .catch(error => {
+    console.error(error);
+    process.exit(1);
+  });
@@ -0,0 +1,104 @@
+// Measures the heap each queued event costs, as the growth of glibc's in-use bytes while 100k MODIFIED events for one
+// file in a 200 character directory are queued and held. The event layout the queue started with, an Event of three
+// std::string fields behind a separately allocated OPA queue node, is rebuilt here so the two can be compared on the
+// same allocator.
+//
+// The current queue is measured the way each backend feeds it: inotify hands every event in a directory the same
+// PathHandle, win32 and FSEvents pass the directory as a std::string. A queued event has to cost at most half of
+// what the original layout did, and the benchmark exits with 1 when it does not.
+//
+// Build and run from the repository root on Linux with glibc 2.33 or later:
+//   gcc -O2 -DOPA_HAVE_GCC_INTRINSIC_ATOMICS=1 -DHAVE_STDDEF_H=1 -Iopenpa/src
+//     -c openpa/src/opa_queue.c openpa/src/opa_primitives.c
+//   g++ -std=c++11 -O2 -DOPA_HAVE_GCC_INTRINSIC_ATOMICS=1 -DHAVE_STDDEF_H=1 -Iopenpa/src -Iincludes
+//     bench/memory.cpp src/Queue.cpp src/Pool.cpp opa_queue.o opa_primitives.o -luv -lpthread -o memory-bench
+//   ./memory-bench
+#include "Queue.h"
+#include <cstdio>
+#include <cstring>
+#include <malloc.h>
+#include <string>
+extern "C" {
+#  include <opa_queue.h>
+}
+
+#define EVENTS 100000
+#define DIRECTORY_LENGTH 200
+
+static size_t heapInUse() {
+  return mallinfo2().uordblks;
+}
+
+// The original layout: three strings per event and a queue node of its own
+struct OriginalEvent {
+  EventType type;
+  std::string directory, fileA, fileB;
+};
+
+struct OriginalNode {
+  OPA_Queue_element_hdr_t header;
+  OriginalEvent *event;
+};
+
+static double originalBytesPerEvent(const std::string &directory) {
+  OPA_Queue_info_t queue;
+  OPA_Queue_init(&queue);
+
+  size_t before = heapInUse();
+  for (int i = 0; i < EVENTS; ++i) {
+    OriginalEvent *event = new OriginalEvent;
+    event->type = MODIFIED;
+    event->directory = directory;
+    event->fileA = "file.txt";
+    OriginalNode *node = new OriginalNode;
+    OPA_Queue_header_init(&node->header);
+    node->event = event;
+    OPA_Queue_enqueue(&queue, node, OriginalNode, header);
+  }
+  double bytesPerEvent = (double)(heapInUse() - before) / EVENTS;
+
+  while (!OPA_Queue_is_empty(&queue)) {
+    OriginalNode *node;
+    OPA_Queue_dequeue(&queue, node, OriginalNode, header);
+    delete node->event;
+    delete node;
+  }
+  return bytesPerEvent;
+}
+
+// The queue stays alive until every measurement is done, since freed events go back to a pool the next run would
+// draw from without touching the heap
+template <typename Directory>
+static double queuedBytesPerEvent(EventQueue &queue, const Directory &directory) {
+  size_t before = heapInUse();
+  for (int i = 0; i < EVENTS; ++i) {
+    queue.enqueue(MODIFIED, directory, "file.txt");
+  }
+  return (double)(heapInUse() - before) / EVENTS;
+}
+
+int main() {
+  std::string directory = "/home/user/projects/" + std::string(DIRECTORY_LENGTH - 20, 'd');
+  PathHandle handle = std::make_shared<const std::string>(directory);
+
+  QueueCapacity capacity = { 0, 0, COLLAPSE_TO_OVERFLOW };
+  EventQueue inotifyQueue("/", capacity, false, ALL_ACTIONS), stringQueue("/", capacity, false, ALL_ACTIONS);
+
+  // the header and the names make up the pooled block, the rest is the block's size class, its prefix, the
+  // allocator's own overhead and the event's slot in the ring
+  printf("event header:                 %6u bytes\n", (unsigned)sizeof(Event));
+  printf("event with its names:         %6u bytes\n", (unsigned)(sizeof(Event) + strlen("file.txt") + 2));
+
+  double original = originalBytesPerEvent(directory);
+  double shared = queuedBytesPerEvent(inotifyQueue, handle);
+  double copied = queuedBytesPerEvent(stringQueue, directory);
+  printf("original layout:              %6.1f bytes/event\n", original);
+  printf("queue, shared PathHandle:     %6.1f bytes/event\n", shared);
+  printf("queue, directory as a string: %6.1f bytes/event\n", copied);
+
+  if (shared > original / 2 || copied > original / 2) {
+    printf("a queued event costs more than half of the original layout\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,149 @@
+// Compares the OPA queue the event queue used to sit on with the RingQueue that replaced it. Throughput is measured
+// with one producer thread and one consumer thread, the way a watcher uses them. Latency is measured per call, filling
+// and draining bursts on one thread, so that it shows the cost of each operation rather than of the scheduler.
+//
+// Build and run from the repository root on Linux or macOS:
+//   gcc -O2 -DOPA_HAVE_GCC_INTRINSIC_ATOMICS=1 -DHAVE_STDDEF_H=1 -Iopenpa/src
+//     -c openpa/src/opa_queue.c openpa/src/opa_primitives.c
+//   g++ -std=c++11 -O2 -DOPA_HAVE_GCC_INTRINSIC_ATOMICS=1 -DHAVE_STDDEF_H=1 -Iopenpa/src -Iincludes
+//     bench/queue.cpp opa_queue.o opa_primitives.o -lpthread -o queue-bench
+//   ./queue-bench
+#include "RingQueue.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+extern "C" {
+#  include <opa_queue.h>
+}
+
+#define ITEMS (1 << 22)
+#define BURST 4096 // divides ITEMS
+
+typedef std::chrono::steady_clock Clock;
+
+static int64_t nanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+struct Item {
+  OPA_Queue_element_hdr_t header;
+};
+
+// Each queue is driven through the same two operations
+class OPAAdapter {
+public:
+  OPAAdapter() {
+    OPA_Queue_init(&mQueue);
+  }
+
+  void push(Item *item) {
+    OPA_Queue_header_init(&item->header);
+    OPA_Queue_enqueue(&mQueue, item, Item, header);
+  }
+
+  bool pop(Item *&item) {
+    if (OPA_Queue_is_empty(&mQueue)) {
+      return false;
+    }
+    OPA_Queue_dequeue(&mQueue, item, Item, header);
+    return true;
+  }
+
+private:
+  OPA_Queue_info_t mQueue;
+};
+
+class RingAdapter {
+public:
+  void push(Item *item) {
+    mQueue.push(item);
+  }
+
+  bool pop(Item *&item) {
+    return mQueue.pop(item);
+  }
+
+private:
+  RingQueue<Item *> mQueue;
+};
+
+template <typename Queue>
+static double throughput(std::vector<Item> &items) {
+  Queue queue;
+  int64_t start = nanoseconds();
+
+  std::thread producer([&]() {
+    for (int i = 0; i < ITEMS; ++i) {
+      queue.push(&items[i]);
+    }
+  });
+
+  Item *item;
+  for (int received = 0; received < ITEMS;) {
+    if (queue.pop(item)) {
+      ++received;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+
+  producer.join();
+  return ITEMS / ((nanoseconds() - start) / 1e9);
+}
+
+template <typename Queue>
+static void latency(std::vector<Item> &items, std::vector<int64_t> &pushes, std::vector<int64_t> &pops) {
+  Queue queue;
+  pushes.clear();
+  pops.clear();
+
+  Item *item;
+  for (int i = 0; i < ITEMS; i += BURST) {
+    for (int j = i; j < i + BURST; ++j) {
+      int64_t start = nanoseconds();
+      queue.push(&items[j]);
+      pushes.push_back(nanoseconds() - start);
+    }
+    for (int j = i; j < i + BURST; ++j) {
+      int64_t start = nanoseconds();
+      queue.pop(item);
+      pops.push_back(nanoseconds() - start);
+    }
+  }
+}
+
+static void printPercentiles(const char *operation, std::vector<int64_t> &samples) {
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  printf(
+    "    %-4s p50 %5lld ns   p99 %5lld ns   p99.9 %6lld ns   max %8lld ns\n",
+    operation,
+    (long long)samples[n / 2],
+    (long long)samples[n * 99 / 100],
+    (long long)samples[n * 999 / 1000],
+    (long long)samples[n - 1]
+  );
+}
+
+template <typename Queue>
+static void report(const char *name, std::vector<Item> &items) {
+  std::vector<int64_t> pushes, pops;
+  pushes.reserve(ITEMS);
+  pops.reserve(ITEMS);
+
+  printf("%s: %.1f M items/s\n", name, throughput<Queue>(items) / 1e6);
+  latency<Queue>(items, pushes, pops);
+  printPercentiles("push", pushes);
+  printPercentiles("pop", pops);
+}
+
+int main() {
+  std::vector<Item> items(ITEMS);
+
+  report<OPAAdapter>("OPA_Queue", items);
+  report<RingAdapter>("RingQueue", items);
+
+  return 0;
+}
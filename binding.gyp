@@ -8,11 +8,20 @@
 
         "sources": [
             "src/NSFW.cpp",
+            "src/Pool.cpp",
             "src/Queue.cpp",
             "src/NativeInterface.cpp",
+            "src/NetEffect.cpp",
+            "src/Quiescence.cpp",
+            "src/AtomicSave.cpp",
             "includes/NSFW.h",
+            "includes/Pool.h",
             "includes/Queue.h",
-            "includes/NativeInterface.h"
+            "includes/RingQueue.h",
+            "includes/NativeInterface.h",
+            "includes/NetEffect.h",
+            "includes/Quiescence.h",
+            "includes/AtomicSave.h"
         ],
         "win_delay_load_hook": "false",
         "include_dirs": [
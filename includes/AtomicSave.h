@@ -0,0 +1,26 @@
+#ifndef NSFW_ATOMIC_SAVE_H
+#define NSFW_ATOMIC_SAVE_H
+
+#include "Queue.h"
+#include <string>
+#include <vector>
+
+// Recognizes a file saved by writing a temporary file next to it and renaming that over it. Within a batch, a temp
+// file that is created, optionally modified, and renamed in the same directory to a name that is not a temp name
+// becomes a single MODIFIED on the target. A deletion of the target earlier in the batch, which some tools do before
+// the rename, is folded in as well. Temp names are recognized by glob patterns on the name, where * matches any run
+// of characters and ? any one character.
+class AtomicSave {
+public:
+  AtomicSave(const std::vector<std::string> &patterns);
+
+  void reduce(std::vector<Event *> &events);
+
+private:
+  bool isTemp(const char *name, size_t length) const;
+  static bool matches(const std::string &pattern, const char *name, size_t length);
+
+  std::vector<std::string> mPatterns;
+};
+
+#endif
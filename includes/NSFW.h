@@ -1,50 +1,161 @@
 #ifndef NSFW_H
 #define NSFW_H
 
+#include "AtomicSave.h"
 #include "NativeInterface.h"
+#include "NetEffect.h"
+#include "Quiescence.h"
 #include <nan.h>
+#include <unordered_map>
 #include <uv.h>
 #include <vector>
 
 using namespace Nan;
 
+enum DebounceMode {
+  DEBOUNCE_TRAILING = 0,
+  DEBOUNCE_LEADING = 1,
+  DEBOUNCE_BOTH = 2
+};
+
+enum BatchFormat {
+  BATCH_OBJECTS = 0,
+  BATCH_GROUPED = 1,
+  BATCH_BINARY = 2
+};
+
+// A limit of 0 leaves that dimension unbounded
+struct CallbackLimits {
+  uint32_t events;
+  uint32_t bytes;
+  uint32_t ms;
+};
+
 class NSFW : public ObjectWrap {
 public:
   static NAN_MODULE_INIT(Init);
 
-  static void cleanupEventCallback(void *arg);
   static void fireErrorCallback(uv_async_t *handle);
   static void fireEventCallback(uv_async_t *handle);
   static void pollForEvents(void *arg);
 
   Persistent<v8::Object> mPersistentHandle;
+  AtomicSave *mAtomicSave;
+  BatchFormat mBatchFormat;
+  CallbackLimits mCallbackLimits;
+  bool mCoalesce;
+  uint32_t mDebounceMaxMS;
+  uint32_t mDebounceMinMS;
+  DebounceMode mDebounceMode;
   uint32_t mDebounceMS;
+  OPA_int_t mDemand;
+  OPA_int_t mEffectiveDebounceMS;
   uv_async_t mErrorCallbackAsync;
   uv_async_t mEventCallbackAsync;
+  OPA_Queue_info_t mEventBatons;
   Callback *mErrorCallback;
   Callback *mEventCallback;
   NativeInterface *mInterface;
   uv_mutex_t mInterfaceLock;
   bool mInterfaceLockValid;
+  NetEffect *mNetEffect;
   std::string mPath;
+  OPA_int_t mPendingBatons;
   uv_thread_t mPollThread;
+  bool mPull;
+  uint32_t mPulls;
+  QueueCapacity mQueueCapacity;
+  Quiescence *mQuiescence;
   bool mRunning;
+  Callback *mSettledCallback;
+  uint32_t mSettleMS;
+  bool mUnsettled;
+  WatchOptions mWatchOptions;
 private:
-  NSFW(uint32_t debounceMS, std::string path, Callback *eventCallback, Callback *errorCallback);
+  NSFW(
+    uint32_t debounceMS,
+    uint32_t debounceMinMS,
+    uint32_t debounceMaxMS,
+    DebounceMode debounceMode,
+    QueueCapacity queueCapacity,
+    WatchOptions watchOptions,
+    CallbackLimits callbackLimits,
+    uint32_t quietMS,
+    uint32_t settleMS,
+    BatchFormat batchFormat,
+    const std::vector<std::string> &atomicSavePatterns,
+    bool coalesce,
+    bool netEffect,
+    bool pull,
+    std::string path,
+    Callback *eventCallback,
+    Callback *errorCallback,
+    Callback *settledCallback
+  );
   ~NSFW();
 
+  void adaptDebounce(uint32_t eventCount, uint64_t elapsedNS);
+  bool checkForError();
+  uint32_t deliverEvents();
+  void handOver(std::vector<Event *> *events);
+  void pollQuietly();
+  bool readyForEvents();
+  void settle(uint64_t idleSince);
+  uint32_t settleTimeout(uint64_t idleSince);
+
   struct ErrorBaton {
     NSFW *nsfw;
     std::string error;
   };
 
   struct EventBaton {
+    OPA_Queue_element_hdr_t header;
     NSFW *nsfw;
     std::vector<Event *> *events;
+    size_t delivered;
+    bool settled; // carries no events, only tells JS the tree has settled
+  };
+
+  EventBaton *mPartialBaton;
+
+  bool callEventCallback(EventBaton *baton);
+  void discardEventBatons();
+  void drainEventBatons(bool flushing);
+  static void freeEventBaton(EventBaton *baton);
+
+  // Each format builds a chunk from begin up to end, and moves end back if it runs out of time first
+  typedef std::vector<Event *>::const_iterator EventIterator;
+  static v8::Local<v8::Value> groupEvents(EventIterator begin, EventIterator &end, uint64_t deadline);
+  static v8::Local<v8::Value> packEvents(EventIterator begin, EventIterator &end, uint64_t deadline);
+  static v8::Local<v8::Value> toEventObjects(EventIterator begin, EventIterator &end, uint64_t deadline);
+
+  class EventObjectBuilder {
+  public:
+    EventObjectBuilder();
+    v8::Local<v8::String> directory(const std::string *directory);
+    v8::Local<v8::Object> event(Event *event, v8::Local<v8::String> directory);
+  private:
+    v8::Local<v8::String> mActionKey;
+    v8::Local<v8::String> mDirectoryKey;
+    v8::Local<v8::String> mFileKey;
+    v8::Local<v8::String> mOldFileKey;
+    v8::Local<v8::String> mNewFileKey;
+    v8::Local<v8::Object> mChange;
+    v8::Local<v8::Object> mCoalesced;
+    v8::Local<v8::String> mCountKey;
+    v8::Local<v8::Object> mOverflow;
+    v8::Local<v8::Object> mRename;
+    std::unordered_map<std::string, v8::Local<v8::String> > mDirectories;
+    const std::string *mLastDirectory;
+    v8::Local<v8::String> mLastDirectoryString;
   };
 
   static NAN_METHOD(JSNew);
 
+  static NAN_METHOD(GetStats);
+
+  static NAN_METHOD(RequestEvents);
+
   static NAN_METHOD(Start);
   class StartWorker : public AsyncWorker {
   public:
@@ -66,6 +177,23 @@ private:
   };
 
   static Persistent<v8::Function> constructor;
+
+  // Built once in Init and shared by every watcher
+  struct EventShapes {
+    Persistent<v8::String> action;
+    Persistent<v8::String> directory;
+    Persistent<v8::String> file;
+    Persistent<v8::String> oldFile;
+    Persistent<v8::String> newFile;
+    Persistent<v8::String> events;
+    Persistent<v8::String> count;
+    Persistent<v8::Object> change;
+    Persistent<v8::Object> coalesced;
+    Persistent<v8::Object> overflow;
+    Persistent<v8::Object> rename;
+    Persistent<v8::Object> group;
+  };
+  static EventShapes eventShapes;
 };
 
 #endif
@@ -6,12 +6,22 @@
 
 class NativeInterface {
 public:
-  NativeInterface(std::string path);
+  NativeInterface(std::string path, QueueCapacity capacity, bool coalesce, WatchOptions options);
 
+  int getCoalescedEventCount();
+  int getDroppedEventCount();
   std::string getError();
   std::vector<Event *> *getEvents();
+  int getQueuedEventCount();
+  int getSpilledEventCount();
   bool hasErrored();
   bool isWatching();
+  void interrupt();
+  void pause(uint32_t milliseconds);
+  void setHeldEvents(uint32_t events, uint32_t bytes);
+  void sleep(uint32_t milliseconds);
+  bool waitForEvents(uint32_t milliseconds);
+  void wake();
 
   ~NativeInterface();
 private:
@@ -0,0 +1,46 @@
+#ifndef NSFW_NET_EFFECT_H
+#define NSFW_NET_EFFECT_H
+
+#include "Queue.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Reduces a batch to the net effect on each path it touches:
+//   CREATED then DELETED          nothing
+//   CREATED then MODIFIED         CREATED
+//   MODIFIED then MODIFIED        MODIFIED
+//   MODIFIED then DELETED         DELETED
+//   CREATED a then RENAMED a, b   CREATED b
+//   RENAMED a, b then RENAMED b, c RENAMED a, c, or nothing when c is a
+//   RENAMED a, b then DELETED b   DELETED a
+//   MODIFIED a then RENAMED a, b  MODIFIED a, RENAMED a, b, and the modification goes with the file: DELETED b
+//                                 leaves just DELETED a, and renaming it back to a leaves just MODIFIED a
+// Paths are a directory and a name, so events below a directory that is renamed or deleted within the batch keep
+// their own paths. Anything the rules do not cover is left where it was, and the batch keeps its order otherwise.
+class NetEffect {
+public:
+  void reduce(std::vector<Event *> &events);
+
+private:
+  // Indexes into the batch of the events that still stand for a path, -1 for none. other is the latest event for the
+  // path that no rule builds on, such as a deletion. originModified is a modification reported under the name the
+  // file had before renamed.
+  struct Path {
+    Path(): created(-1), modified(-1), originModified(-1), other(-1), renamed(-1) {}
+
+    int created;
+    int modified;
+    int originModified;
+    int other;
+    int renamed;
+  };
+
+  bool idle(const std::string &path);
+  static void remove(std::vector<Event *> &events, int index);
+  static void replace(std::vector<Event *> &events, int index, Event *event);
+
+  std::unordered_map<std::string, Path> mPaths;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef NSFW_POOL_H
+#define NSFW_POOL_H
+
+#include <cstddef>
+#include <uv.h>
+extern "C" {
+#  include <opa_queue.h>
+#  include <opa_primitives.h>
+}
+
+// A free list of fixed size blocks shared by every thread. Any thread may release a block without taking a lock,
+// since releases go through the multi-producer OPA queue; allocations are serialized because it has a single consumer.
+class Pool {
+public:
+  Pool(size_t blockSize, int maxFreeBlocks);
+  ~Pool();
+
+  void *allocate();
+  void release(void *block);
+
+  static int heapAllocations(); // Blocks taken from the heap by every pool, steady state does not move this
+
+private:
+  struct Block {
+    OPA_Queue_element_hdr_t header;
+  };
+
+  uv_mutex_t mAllocateLock;
+  size_t mBlockSize;
+  OPA_Queue_info_t mFreeBlocks;
+  int mMaxFreeBlocks;
+  OPA_int_t mNumFreeBlocks;
+
+  static OPA_int_t sHeapAllocations;
+
+  friend class SizedPool;
+};
+
+// Blocks of any size, each drawn from the Pool of the smallest size class it fits. Anything larger than the largest
+// class comes straight from the heap. Every block remembers where it came from, so release needs no size.
+class SizedPool {
+public:
+  SizedPool(int maxFreeBlocks);
+  ~SizedPool();
+
+  void *allocate(size_t size);
+  static void release(void *block);
+
+private:
+  struct BlockPrefix {
+    Pool *pool;
+  };
+
+  static const int NUM_SIZE_CLASSES = 8;
+  static const size_t SIZE_CLASSES[NUM_SIZE_CLASSES];
+
+  Pool *mPools[NUM_SIZE_CLASSES];
+};
+
+#endif
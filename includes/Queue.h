@@ -1,7 +1,15 @@
 #ifndef NSFW_QUEUE_H
 #define NSFW_QUEUE_H
 
+#include "Pool.h"
+#include "RingQueue.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <uv.h>
+#include <vector>
 extern "C" {
 #  include <opa_queue.h>
 #  include <opa_primitives.h>
@@ -11,36 +19,160 @@ enum EventType {
   CREATED = 0,
   DELETED = 1,
   MODIFIED = 2,
-  RENAMED = 3
+  RENAMED = 3,
+  OVERFLOWED = 4
 };
 
+// A set of EventTypes has bit 1 << type set for each of them
+#define ALL_ACTIONS ((1 << CREATED) | (1 << DELETED) | (1 << MODIFIED) | (1 << RENAMED) | (1 << OVERFLOWED))
+
+enum OverflowPolicy {
+  DROP_OLDEST = 0,
+  DROP_NEWEST = 1,
+  COLLAPSE_TO_OVERFLOW = 2,
+  SPILL = 3
+};
+
+// Every event in a directory shares one copy of its path, backends that keep the path around hand out the copy they
+// already hold
+typedef std::shared_ptr<const std::string> PathHandle;
+
+// Characters borrowed from someone else's buffer, so a name travels from the backend into its event with no copies on
+// the way
+struct StringView {
+  StringView(): data(""), length(0) {}
+  StringView(const char *data): data(data), length(strlen(data)) {}
+  StringView(const char *data, size_t length): data(data), length(length) {}
+  StringView(const std::string &string): data(string.data()), length(string.size()) {}
+
+  const char *data;
+  size_t length;
+};
+
+// A directory and a name joined by a NUL, which neither can contain, to key maps by path
+std::string pathKey(const std::string &directory, StringView file);
+
+// An event is a single block from a SizedPool: this header followed by fileA and fileB, each NUL terminated. Create
+// events with Event::create and free them with delete.
 struct Event {
-  EventType type;
-  std::string directory, fileA, fileB;
+  PathHandle directory;
+  uint64_t arrived; // uv_hrtime() when the queue took the event in, or last merged a modification into it
+  uint16_t fileALength; // File names are at most 255 characters on every platform we watch
+  uint16_t fileBLength;
+  uint16_t count; // How many MODIFIED events a coalescing queue merged into this one, stops at 65535
+  uint8_t type; // An EventType, narrowed so the header stays at 32 bytes
+
+  static Event *create(
+    EventType type,
+    const PathHandle &directory,
+    StringView fileA,
+    StringView fileB = StringView()
+  );
+  static void operator delete(void *event);
+
+  const char *fileA() const { return reinterpret_cast<const char *>(this + 1); }
+  const char *fileB() const { return fileA() + fileALength + 1; }
+  std::string keyA() const { return pathKey(*directory, StringView(fileA(), fileALength)); }
+  std::string keyB() const { return pathKey(*directory, StringView(fileB(), fileBLength)); }
+  size_t size() const { return sizeof(Event) + fileALength + fileBLength + 2; }
+
+private:
+  Event(EventType type, const PathHandle &directory, StringView fileA, StringView fileB);
+  static void *operator new(size_t size);
+
+  static SizedPool sPool;
+};
+
+// A limit of 0 leaves that dimension unbounded
+struct QueueCapacity {
+  uint32_t events;
+  uint32_t bytes;
+  OverflowPolicy policy;
+};
+
+// What a backend reports, set per watcher. A backend with no way to honor an option ignores it.
+struct WatchOptions {
+  bool closeWrite; // Report a modification when a file written to is closed, rather than on every write
+  uint32_t actions; // The set of EventTypes to report, see ALL_ACTIONS
 };
 
 class EventQueue {
 public:
-  EventQueue();
+  // Only events of the given set of actions are queued, overflows always are
+  EventQueue(std::string root, QueueCapacity capacity, bool coalesce, uint32_t actions);
   ~EventQueue();
 
+  int bytes(); // Only tracked when the capacity limits bytes
   void clear();
+  int coalesced();
   int count();
   Event *dequeue(); // Free this pointer when you are done with it
+  size_t dequeueAll(std::vector<Event *> &events); // Appends every event in memory, free each when you are done
+  int dropped();
+  static int eventSize(const Event *event); // What an event counts for against a byte limit
+  // Events the consumer has taken but is still holding back count toward the limits too. drop-oldest can only
+  // discard what is still queued, so once held events alone fill the limits, new events are dropped instead.
+  void setHeld(uint32_t events, uint32_t bytes);
+  void refill(); // Reads spilled events back into memory once the events in memory are gone
+  int spilled();
   void enqueue(
     EventType type,
-    std::string directory,
-    std::string fileA,
-    std::string fileB = ""
+    const PathHandle &directory,
+    StringView fileA,
+    StringView fileB = StringView()
   );
+  void enqueue(
+    EventType type,
+    const std::string &directory,
+    StringView fileA,
+    StringView fileB = StringView()
+  );
+  void interrupt(); // Cuts short every wait, now and from then on, for when the watcher stops or fails
+  void pause(uint32_t milliseconds); // Blocks for the given time unless wake() or interrupt() is called
+  void sleep(uint32_t milliseconds); // Blocks for the given time unless interrupt() is called
+  // Blocks until an event is queued, wake() or interrupt() is called or the time runs out, 0 waits as long as it
+  // takes. Returns whether events are queued.
+  bool wait(uint32_t milliseconds);
+  void wake(); // Tells a waiter the consumer is ready for more, a sleep carries on
 
 private:
-  struct EventNode {
-    OPA_Queue_element_hdr_t header;
-    Event *event;
-  };
-  OPA_Queue_info_t mQueue;
+  static int eventSize(size_t directoryLength, size_t fileALength, size_t fileBLength);
+  bool coalesce(EventType type, const std::string &directory, StringView fileA, StringView fileB);
+  Event *dequeueUnlocked();
+  Event *enqueueEvent(EventType type, const PathHandle &directory, StringView fileA, StringView fileB);
+  bool hasRoomFor(int size);
+  void push(Event *event);
+  Event *readSpilled();
+  void signalWaiter();
+  bool spill(Event *event);
+  bool wanted(EventType type) const { return (mActions & (1 << type)) != 0; }
+
+  uint32_t mActions;
+  QueueCapacity mCapacity;
+  bool mCoalesce;
+  uv_mutex_t mCoalesceLock;
+  uv_mutex_t mDequeueLock;
+  bool mInterrupted;
+  PathHandle mLastDirectory;
+  PathHandle mLastSpilledDirectory;
+  OPA_int_t mNumBytes;
+  OPA_int_t mNumCoalesced;
+  OPA_int_t mNumDropped;
+  std::unordered_map<std::string, Event *> mPendingModified;
+  RingQueue<Event *> mQueue;
   OPA_int_t mNumEvents;
+  OPA_int_t mNumHeld;
+  OPA_int_t mNumHeldBytes;
+  PathHandle mRoot;
+  uv_cond_t mSignal;
+  FILE *mSpillFile;
+  uv_mutex_t mSpillLock;
+  int64_t mSpillReadOffset;
+  int64_t mSpillWriteOffset;
+  OPA_int_t mNumSpilled;
+  uv_mutex_t mSignalLock;
+  OPA_int_t mWaiting;
+  bool mWoken;
 };
 
 #endif
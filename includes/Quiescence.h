@@ -0,0 +1,57 @@
+#ifndef NSFW_QUIESCENCE_H
+#define NSFW_QUIESCENCE_H
+
+#include "Queue.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Holds the events of each path until no more have arrived for it in a quiet period, then releases them together in
+// the order they arrived. The period runs from when the queue took each event in, not from when it is held. Held paths
+// wait on a hashed timer wheel whose slots are each a tick wide, so holding, resetting and releasing a path costs the
+// same however many are pending.
+//
+// A rename is held under its new name, along with whatever was still held under the old one, in arrival order. An
+// overflow releases everything held ahead of it. Times are in milliseconds. Only the poll thread uses it.
+class Quiescence {
+public:
+  Quiescence(uint32_t quietMS);
+  ~Quiescence();
+
+  bool empty() const;
+  uint32_t heldBytes() const { return mHeldBytes; } // As EventQueue::eventSize counts them
+  uint32_t heldEvents() const { return mHeldEvents; }
+  void hold(std::vector<Event *> &events, uint64_t now);
+  uint64_t nextRelease() const; // UINT64_MAX when nothing is held
+  void release(uint64_t now, std::vector<Event *> &released);
+  void releaseAll(std::vector<Event *> &released);
+
+private:
+  struct Path {
+    std::string key;
+    std::vector<Event *> events;
+    uint64_t deadline; // in ticks
+    Path *previous;
+    Path *next;
+  };
+
+  void advance(uint64_t now);
+  void forget(const std::vector<Event *> &events, size_t from);
+  void link(Path *path);
+  Path *reset(const std::string &name);
+  void settle(Path *path);
+  void takeAll(std::vector<Event *> &events);
+  void unlink(Path *path);
+
+  uint32_t mHeldBytes;
+  uint32_t mHeldEvents;
+  std::unordered_map<std::string, Path *> mPaths;
+  uint32_t mQuietTicks;
+  std::vector<Event *> mSettled;
+  std::vector<Path *> mSlots;
+  uint64_t mTick;
+  uint32_t mTickMS;
+};
+
+#endif
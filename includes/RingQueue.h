@@ -0,0 +1,137 @@
+#ifndef NSFW_RING_QUEUE_H
+#define NSFW_RING_QUEUE_H
+
+#include <cstddef>
+extern "C" {
+#  include <opa_primitives.h>
+}
+
+#define RING_QUEUE_CACHE_LINE 64
+
+// An unbounded single-producer/single-consumer queue built from fixed size ring segments. The producer fills the tail
+// segment and links a new one once it is full, the consumer drains the head segment and follows the link. Neither side
+// takes a lock, and each publishes a whole batch with a single release store.
+//
+// Exactly one thread may push and one may pop at a time. Callers that switch threads on either side must order the
+// switch themselves, with a mutex for instance.
+template <typename T, int SEGMENT_SIZE = 1024>
+class RingQueue {
+public:
+  RingQueue() {
+    mHead = mTail = new Segment;
+    mHeadIndex = 0;
+    OPA_store_ptr(&mSpare, NULL);
+  }
+
+  ~RingQueue() {
+    while (mHead != NULL) {
+      Segment *next = (Segment *)OPA_load_ptr(&mHead->next);
+      delete mHead;
+      mHead = next;
+    }
+    delete (Segment *)OPA_load_ptr(&mSpare);
+  }
+
+  // Consumer side: returns false when nothing is queued
+  bool pop(T &item) {
+    return pop(&item, 1) == 1;
+  }
+
+  // Consumer side: moves up to max items into out, oldest first, and returns how many it moved
+  size_t pop(T *out, size_t max) {
+    size_t popped = 0;
+    while (popped < max) {
+      int available = OPA_load_acquire_int(&mHead->tail) - mHeadIndex;
+      if (available == 0) {
+        if (mHeadIndex < SEGMENT_SIZE || !advanceHead()) {
+          break;
+        }
+        continue;
+      }
+
+      size_t take = (size_t)available < max - popped ? (size_t)available : max - popped;
+      for (size_t i = 0; i < take; ++i) {
+        out[popped + i] = mHead->slots[mHeadIndex + i];
+      }
+      mHeadIndex += (int)take;
+      popped += take;
+    }
+    return popped;
+  }
+
+  // Producer side
+  void push(const T &item) {
+    push(&item, 1);
+  }
+
+  // Producer side: queues count items in order
+  void push(const T *items, size_t count) {
+    while (count > 0) {
+      int tail = OPA_load_int(&mTail->tail);
+      if (tail == SEGMENT_SIZE) {
+        advanceTail();
+        continue;
+      }
+
+      size_t room = (size_t)(SEGMENT_SIZE - tail);
+      size_t put = count < room ? count : room;
+      for (size_t i = 0; i < put; ++i) {
+        mTail->slots[tail + i] = items[i];
+      }
+      OPA_store_release_int(&mTail->tail, tail + (int)put);
+
+      items += put;
+      count -= put;
+    }
+  }
+
+private:
+  struct Segment {
+    Segment() {
+      OPA_store_int(&tail, 0);
+      OPA_store_ptr(&next, NULL);
+    }
+
+    OPA_int_t tail;
+    OPA_ptr_t next;
+    T slots[SEGMENT_SIZE];
+  };
+
+  // The head segment is used up, move on to the next one if the producer has linked it
+  bool advanceHead() {
+    Segment *next = (Segment *)OPA_load_acquire_ptr(&mHead->next);
+    if (next == NULL) {
+      return false;
+    }
+
+    // the producer never touches a segment again once it has linked the next one, so it can be recycled
+    Segment *used = mHead;
+    mHead = next;
+    mHeadIndex = 0;
+
+    OPA_store_int(&used->tail, 0);
+    OPA_store_ptr(&used->next, NULL);
+    delete (Segment *)OPA_swap_ptr(&mSpare, used);
+    return true;
+  }
+
+  void advanceTail() {
+    Segment *segment = (Segment *)OPA_swap_ptr(&mSpare, NULL);
+    if (segment == NULL) {
+      segment = new Segment;
+    }
+
+    OPA_store_release_ptr(&mTail->next, segment);
+    mTail = segment;
+  }
+
+  // consumer state and producer state live on separate cache lines
+  Segment *mHead;
+  int mHeadIndex;
+  char mHeadPadding[RING_QUEUE_CACHE_LINE];
+  Segment *mTail;
+  char mTailPadding[RING_QUEUE_CACHE_LINE];
+  OPA_ptr_t mSpare;
+};
+
+#endif
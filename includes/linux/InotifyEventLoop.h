@@ -4,6 +4,7 @@
 #include "InotifyService.h"
 #include "../Lock.h"
 #include <sys/inotify.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
@@ -28,11 +29,12 @@ public:
   ~InotifyEventLoop();
 private:
   static const int BUFFER_SIZE = 8192;
+  // The name is copied out of the read buffer, which the next read overwrites before the rename completes
   struct InotifyRenameEvent {
     uint32_t cookie;
     bool isDirectory;
     bool isGood;
-    std::string name;
+    char name[NAME_MAX + 1];
     int wd;
   };
 
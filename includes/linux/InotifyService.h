@@ -12,7 +12,7 @@ class InotifyTree;
 
 class InotifyService {
 public:
-  InotifyService(EventQueue &queue, std::string path);
+  InotifyService(EventQueue &queue, std::string path, WatchOptions options);
 
   std::string getError();
   bool hasErrored();
@@ -20,16 +20,16 @@ public:
 
   ~InotifyService();
 private:
-  void create(int wd, std::string name);
-  void createDirectory(int wd, std::string name);
+  void create(int wd, StringView name);
+  void createDirectory(int wd, StringView name);
   void createDirectoryTree(std::string directoryTreePath);
-  void dispatch(EventType action, int wd, std::string name);
-  void dispatchRename(int wd, std::string oldName, std::string newName);
-  void modify(int wd, std::string name);
-  void remove(int wd, std::string name);
+  void dispatch(EventType action, int wd, StringView name);
+  void dispatchRename(int wd, StringView oldName, StringView newName);
+  void modify(int wd, StringView name);
+  void remove(int wd, StringView name);
   void removeDirectory(int wd);
-  void rename(int wd, std::string oldName, std::string newName);
-  void renameDirectory(int wd, std::string oldName, std::string newName);
+  void rename(int wd, StringView oldName, StringView newName);
+  void renameDirectory(int wd, StringView oldName, StringView newName);
 
   InotifyEventLoop *mEventLoop;
   EventQueue &mQueue;
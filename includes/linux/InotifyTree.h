@@ -1,5 +1,6 @@
 #ifndef INOTIFY_TREE_H
 #define INOTIFY_TREE_H
+#include "../Queue.h"
 #include <sys/inotify.h>
 #include <sys/stat.h>
 #include <dirent.h>
@@ -12,16 +13,16 @@
 
 class InotifyTree {
 public:
-  InotifyTree(int inotifyInstance, std::string path);
+  InotifyTree(int inotifyInstance, std::string path, WatchOptions options);
 
-  void addDirectory(int wd, std::string name);
+  void addDirectory(int wd, const std::string &name);
   std::string getError();
-  bool getPath(std::string &out, int wd);
+  bool getPath(PathHandle &out, int wd);
   bool hasErrored();
   bool isRootAlive();
   bool nodeExists(int wd);
   void removeDirectory(int wd);
-  void renameDirectory(int wd, std::string oldName, std::string newName);
+  void renameDirectory(int wd, const std::string &oldName, const std::string &newName);
 
   ~InotifyTree();
 private:
@@ -35,32 +36,25 @@ private:
       std::string name
     );
 
-    void addChild(std::string name);
+    void addChild(const std::string &name);
     void fixPaths();
-    std::string getFullPath();
+    PathHandle getFullPath();
     std::string getName();
     InotifyNode *getParent();
     bool inotifyInit();
     bool isAlive();
-    void removeChild(std::string name);
-    void renameChild(std::string oldName, std::string newName);
-    void setName(std::string name);
+    void removeChild(const std::string &name);
+    void renameChild(const std::string &oldName, const std::string &newName);
+    void setName(const std::string &name);
 
     ~InotifyNode();
   private:
     static std::string createFullPath(std::string parentPath, std::string name);
-    static const int ATTRIBUTES = IN_ATTRIB
-                                | IN_CREATE
-                                | IN_DELETE
-                                | IN_MODIFY
-                                | IN_MOVED_FROM
-                                | IN_MOVED_TO
-                                | IN_DELETE_SELF;
 
     bool mAlive;
     std::map<std::string, InotifyNode *> *mChildren;
     std::string mDirectory;
-    std::string mFullPath;
+    PathHandle mFullPath;
     const int mInotifyInstance;
     std::string mName;
     InotifyNode *mParent;
@@ -73,8 +67,11 @@ private:
   void addNodeReferenceByWD(int watchDescriptor, InotifyNode *node);
   void removeNodeReferenceByWD(int watchDescriptor);
 
+  static uint32_t watchMask(WatchOptions options);
+
   std::string mError;
   const int mInotifyInstance;
+  const uint32_t mWatchMask; // What every node watches for
   std::map<int, InotifyNode *> *mInotifyNodeByWatchDescriptor;
   InotifyNode *mRoot;
 
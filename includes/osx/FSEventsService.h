@@ -24,7 +24,7 @@ class RunLoop;
 
 class FSEventsService {
 public:
-  FSEventsService(EventQueue &queue, std::string path);
+  FSEventsService(EventQueue &queue, std::string path, WatchOptions options);
 
   friend void FSEventsServiceCallback(
     ConstFSEventStreamRef streamRef,
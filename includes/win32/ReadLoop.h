@@ -11,7 +11,7 @@
 
 class ReadLoop {
 public:
-	ReadLoop(EventQueue &queue, std::string path);
+	ReadLoop(EventQueue &queue, std::string path, WatchOptions options);
 
 	static unsigned int WINAPI startReadLoop(LPVOID arg);
 	static void CALLBACK startRunner(__in ULONG_PTR arg);
@@ -322,6 +322,118 @@ describe('Node Sentinel File Watcher', function() {
     });
   });
 
+  describe('Debounce modes', function() {
+    const LONG_DEBOUNCE = 5000;
+
+    function firstEventLatency(debounceMode) {
+      const file = 'debounce_mode.file';
+      const inPath = path.resolve(workDir, 'test0');
+      let createdAt;
+      let latency = null;
+      let watch;
+
+      return nsfw(
+        workDir,
+        events => {
+          if (latency === null && events.some(element => element.file === file)) {
+            latency = Date.now() - createdAt;
+          }
+        },
+        { debounceMS: LONG_DEBOUNCE, debounceMode }
+      )
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          createdAt = Date.now();
+          return fse.open(path.join(inPath, file), 'w');
+        })
+        .then(fd => fse.close(fd))
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, LONG_DEBOUNCE + TIMEOUT_PER_STEP);
+        }))
+        .then(() => watch.stop())
+        .then(() => latency);
+    }
+
+    it('delivers the first event immediately in leading mode', function(done) {
+      return firstEventLatency('leading')
+        .then(latency => {
+          expect(latency).not.toBe(null);
+          expect(latency).toBeLessThan(LONG_DEBOUNCE / 2);
+        })
+        .then(done, err => done.fail(err));
+    });
+
+    it('holds the first event for the window in trailing mode', function(done) {
+      return firstEventLatency('trailing')
+        .then(latency => {
+          expect(latency).not.toBe(null);
+          expect(latency).not.toBeLessThan(LONG_DEBOUNCE / 2);
+        })
+        .then(done, err => done.fail(err));
+    });
+
+    it('adapts the debounce window to the event rate', function(done) {
+      const inPath = path.resolve(workDir, 'test1');
+      let largestWindow = 0;
+      let watch;
+
+      return nsfw(
+        workDir,
+        () => {
+          largestWindow = Math.max(largestWindow, watch.getStats().debounceMS);
+        },
+        { debounceMS: 10, debounceMinMS: 10, debounceMaxMS: 2000 }
+      )
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          for (let i = 0; i < 2000; ++i) {
+            fse.writeFileSync(path.join(inPath, 'burst' + i + '.file'), 'burst');
+          }
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          expect(largestWindow).toBeGreaterThan(10);
+
+          // the window shrinks as sparse events arrive, touch a file now and then until it is back at the minimum
+          const deadline = Date.now() + 10 * TIMEOUT_PER_STEP;
+          const settle = () => {
+            if (watch.getStats().debounceMS === 10 || Date.now() > deadline) {
+              return Promise.resolve();
+            }
+            fse.writeFileSync(path.join(inPath, 'quiet.file'), 'quiet');
+            return new Promise(resolve => {
+              setTimeout(resolve, DEBOUNCE);
+            }).then(settle);
+          };
+          return settle();
+        })
+        .then(() => {
+          expect(watch.getStats().debounceMS).toBe(10);
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+
+    it('rejects unknown debounce modes', function() {
+      expect(() => nsfw(workDir, () => {}, { debounceMode: 'sometimes' })).toThrow();
+    });
+  });
+
   describe('Recursive', function() {
     it('can listen for the creation of a deeply nested file', function(done) {
       const paths = ['d', 'e', 'e', 'p', 'f', 'o', 'l', 'd', 'e', 'r'];
@@ -451,6 +563,1152 @@ describe('Node Sentinel File Watcher', function() {
     });
   });
 
+  describe('Stop', function() {
+    const LONG_DEBOUNCE = 5000;
+    const MAX_STOP_MS = 100;
+
+    it('stops an idle watcher without waiting out the debounce', function(done) {
+      let watch;
+      let stopStarted;
+
+      return nsfw(
+        workDir,
+        () => {},
+        { debounceMS: LONG_DEBOUNCE }
+      )
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          stopStarted = Date.now();
+          return watch.stop();
+        })
+        .then(() => {
+          expect(Date.now() - stopStarted).toBeLessThan(MAX_STOP_MS);
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+
+    it('stops in the middle of a debounce window', function(done) {
+      const inPath = path.resolve(workDir, 'test1');
+      let watch;
+      let stopStarted;
+
+      return nsfw(
+        workDir,
+        () => {},
+        { debounceMS: LONG_DEBOUNCE }
+      )
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => fse.open(path.join(inPath, 'debounced.file'), 'w'))
+        .then(fd => fse.close(fd))
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, 100);
+        }))
+        .then(() => {
+          stopStarted = Date.now();
+          return watch.stop();
+        })
+        .then(() => {
+          expect(Date.now() - stopStarted).toBeLessThan(MAX_STOP_MS);
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+  });
+
+  describe('Throughput', function() {
+    it('does not drop batches while the event loop is blocked', function(done) {
+      const inPath = path.resolve(workDir, 'test2');
+      const fileCount = 2000;
+      const created = new Set();
+      let watch;
+
+      function findEvent(element) {
+        if (element.action === nsfw.actions.CREATED && element.directory === inPath) {
+          created.add(element.file);
+        }
+      }
+
+      return nsfw(
+        workDir,
+        events => events.forEach(findEvent),
+        { debounceMS: 1 }
+      )
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          // keep the event loop busy so the poll thread hands off many batches before any of them is delivered
+          for (let i = 0; i < fileCount; ++i) {
+            fse.writeFileSync(path.join(inPath, 'flood' + i + '.file'), 'flood');
+            if (i % 100 === 0) {
+              const blockUntil = Date.now() + 20;
+              while (Date.now() < blockUntil) {} // eslint-disable-line no-empty
+            }
+          }
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          expect(created.size).toBe(fileCount);
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+  });
+
+  describe('Chunked delivery', function() {
+    it('splits a batch into callbacks of at most maxCallbackEvents', function(done) {
+      const inPath = path.resolve(workDir, 'test2');
+      const fileCount = 500;
+      const maxCallbackEvents = 25;
+      const created = [];
+      let largestCallback = 0;
+      let watch;
+
+      function handleEvents(events) {
+        largestCallback = Math.max(largestCallback, events.length);
+        events.forEach(element => {
+          if (element.action === nsfw.actions.CREATED && element.directory === inPath) {
+            created.push(element.file);
+          }
+        });
+      }
+
+      return nsfw(workDir, handleEvents, { debounceMS: DEBOUNCE, maxCallbackEvents })
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          for (let i = 0; i < fileCount; ++i) {
+            fse.writeFileSync(path.join(inPath, 'chunk' + i + '.file'), 'chunk');
+          }
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          const expected = [];
+          for (let i = 0; i < fileCount; ++i) {
+            expected.push('chunk' + i + '.file');
+          }
+          expect(created).toEqual(expected);
+          expect(largestCallback).toBe(maxCallbackEvents);
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+  });
+
+  describe('Allocation', function() {
+    it('recycles event memory once a burst has been seen', function(done) {
+      const inPath = path.resolve(workDir, 'test2');
+      let warmAllocations;
+      let watch;
+
+      function burst(prefix, fileCount) {
+        for (let i = 0; i < fileCount; ++i) {
+          fse.writeFileSync(path.join(inPath, prefix + i + '.file'), 'burst');
+        }
+        return new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        });
+      }
+
+      return nsfw(workDir, () => {}, { debounceMS: DEBOUNCE })
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => burst('warm', 500))
+        .then(() => {
+          warmAllocations = watch.getStats().eventAllocations;
+          return burst('steady', 100);
+        })
+        .then(() => {
+          expect(watch.getStats().eventAllocations).toBe(warmAllocations);
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+
+    it('renames and deletes without allocating once warm', function(done) {
+      const inPath = path.resolve(workDir, 'test2');
+      const fileCount = 200;
+      let warmAllocations;
+      let watch;
+
+      function churn(from, to) {
+        for (let i = 0; i < fileCount; ++i) {
+          fse.renameSync(path.join(inPath, from + i + '.file'), path.join(inPath, to + i + '.file'));
+        }
+        return new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        });
+      }
+
+      for (let i = 0; i < fileCount; ++i) {
+        fse.writeFileSync(path.join(inPath, 'churn' + i + '.file'), 'churn');
+      }
+
+      return nsfw(workDir, () => {}, { debounceMS: DEBOUNCE })
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => churn('churn', 'renamed'))
+        .then(() => {
+          warmAllocations = watch.getStats().eventAllocations;
+          return churn('renamed', 'churn');
+        })
+        .then(() => {
+          for (let i = 0; i < fileCount; ++i) {
+            fse.unlinkSync(path.join(inPath, 'churn' + i + '.file'));
+          }
+          return new Promise(resolve => {
+            setTimeout(resolve, TIMEOUT_PER_STEP);
+          });
+        })
+        .then(() => {
+          expect(watch.getStats().eventAllocations).toBe(warmAllocations);
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+  });
+
+  describe('Queue limits', function() {
+    it('collapses a backlog past maxQueueEvents into an overflow event', function(done) {
+      const inPath = path.resolve(workDir, 'test2');
+      let overflowed = false;
+      let watch;
+
+      function findEvent(element) {
+        if (element.action === nsfw.actions.OVERFLOW && element.directory === workDir) {
+          overflowed = true;
+        }
+      }
+
+      return nsfw(
+        workDir,
+        events => events.forEach(findEvent),
+        { debounceMS: 1, maxQueueEvents: 50, overflowPolicy: 'collapse-to-overflow' }
+      )
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          // nothing is delivered while the event loop is blocked, so the backlog builds up in the native queue
+          for (let i = 0; i < 500; ++i) {
+            fse.writeFileSync(path.join(inPath, 'flood' + i + '.file'), 'flood');
+          }
+          const blockUntil = Date.now() + 500;
+          while (Date.now() < blockUntil) {} // eslint-disable-line no-empty
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          const stats = watch.getStats();
+          expect(overflowed).toBe(true);
+          expect(stats.maxQueueEvents).toBe(50);
+          expect(stats.droppedEvents).toBeGreaterThan(0);
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+
+    it('spills a backlog past maxQueueEvents to disk without losing events', function(done) {
+      const inPath = path.resolve(workDir, 'test2');
+      const fileCount = 500;
+      const created = [];
+      let watch;
+
+      function findEvent(element) {
+        if (element.action === nsfw.actions.CREATED && element.directory === inPath) {
+          created.push(element.file);
+        }
+      }
+
+      return nsfw(
+        workDir,
+        events => events.forEach(findEvent),
+        { debounceMS: 1, maxQueueEvents: 50, overflowPolicy: 'spill' }
+      )
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          for (let i = 0; i < fileCount; ++i) {
+            fse.writeFileSync(path.join(inPath, 'flood' + i + '.file'), 'flood');
+          }
+          const blockUntil = Date.now() + 500;
+          while (Date.now() < blockUntil) {} // eslint-disable-line no-empty
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          const expected = [];
+          for (let i = 0; i < fileCount; ++i) {
+            expected.push('flood' + i + '.file');
+          }
+          expect(created).toEqual(expected);
+          expect(watch.getStats().droppedEvents).toBe(0);
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+
+    function floodWithPolicy(overflowPolicy, fileCount) {
+      const inPath = path.resolve(workDir, 'test2');
+      const result = { created: [], overflowed: false };
+      let watch;
+
+      function findEvent(element) {
+        if (element.action === nsfw.actions.OVERFLOW) {
+          result.overflowed = true;
+        } else if (element.action === nsfw.actions.CREATED && element.directory === inPath) {
+          result.created.push(element.file);
+        }
+      }
+
+      return nsfw(
+        workDir,
+        events => events.forEach(findEvent),
+        { debounceMS: 1, maxQueueEvents: 50, overflowPolicy }
+      )
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          for (let i = 0; i < fileCount; ++i) {
+            fse.writeFileSync(path.join(inPath, 'flood' + i + '.file'), 'flood');
+          }
+          const blockUntil = Date.now() + 500;
+          while (Date.now() < blockUntil) {} // eslint-disable-line no-empty
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          result.stats = watch.getStats();
+          return watch.stop();
+        })
+        .then(() => result, err => watch.stop().then(() => Promise.reject(err)));
+    }
+
+    it('drops the oldest events past maxQueueEvents under drop-oldest', function(done) {
+      const fileCount = 500;
+      return floodWithPolicy('drop-oldest', fileCount)
+        .then(result => {
+          expect(result.overflowed).toBe(false);
+          expect(result.stats.droppedEvents).toBeGreaterThan(0);
+          expect(result.created.length).toBeLessThan(fileCount);
+          expect(result.created[result.created.length - 1]).toBe('flood' + (fileCount - 1) + '.file');
+        })
+        .then(done, done.fail);
+    });
+
+    it('drops the newest events past maxQueueEvents under drop-newest', function(done) {
+      const fileCount = 500;
+      return floodWithPolicy('drop-newest', fileCount)
+        .then(result => {
+          expect(result.overflowed).toBe(false);
+          expect(result.stats.droppedEvents).toBeGreaterThan(0);
+          expect(result.created.length).toBeLessThan(fileCount);
+          expect(result.created[0]).toBe('flood0.file');
+          expect(result.created).not.toContain('flood' + (fileCount - 1) + '.file');
+        })
+        .then(done, done.fail);
+    });
+
+    it('rejects unknown overflow policies', function() {
+      expect(() => nsfw(workDir, () => {}, { overflowPolicy: 'sometimes' })).toThrow();
+      expect(() => nsfw(workDir, () => {}, { maxQueueEvents: -1 })).toThrow();
+    });
+  });
+
+  describe('Pull', function() {
+    it('buffers events natively until the next batch is requested', function(done) {
+      const inPath = path.resolve(workDir, 'test2');
+      const file = 'pulled.file';
+      let watch;
+
+      return nsfw(workDir, null, { debounceMS: DEBOUNCE, pull: true })
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => fse.writeFile(path.join(inPath, file), 'pull me'))
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          expect(watch.getStats().queuedEvents).toBeGreaterThan(0);
+          return watch.events().next();
+        })
+        .then(result => {
+          expect(result.done).toBe(false);
+          expect(result.value.some(event =>
+            event.action === nsfw.actions.CREATED && event.directory === inPath && event.file === file
+          )).toBe(true);
+          expect(watch.getStats().queuedEvents).toBe(0);
+
+          const pending = watch.next();
+          return watch.stop().then(() => pending);
+        })
+        .then(batch => {
+          expect(batch).toBe(null);
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+
+    it('keeps pulling after a batch that could not be handed over', function(done) {
+      // stand in for the native watcher so the test can call back the way a failed binary batch does
+      const native = require('../../build/Release/nsfw.node');
+      const indexPath = require.resolve('../src/');
+      const NativeNSFW = native.NSFW;
+      const cachedIndex = require.cache[indexPath];
+      let callbacks;
+      native.NSFW = function(debounceMS, watchPath, eventCallback, errorCallback) {
+        callbacks = { eventCallback, errorCallback };
+        this.requestEvents = () => {};
+      };
+      delete require.cache[indexPath];
+      const stubbedNSFW = require('../src/');
+      native.NSFW = NativeNSFW;
+      require.cache[indexPath] = cachedIndex;
+
+      const errors = [];
+      const watch = new stubbedNSFW(DEBOUNCE, workDir, null, error => errors.push(error), { pull: true });
+      const batch = [{ action: nsfw.actions.CREATED, directory: workDir, file: 'late.file' }];
+      const failed = watch.next();
+
+      callbacks.errorCallback('NSFW could not allocate a binary batch, its events were discarded.', true);
+      expect(() => callbacks.eventCallback(batch)).not.toThrow();
+
+      return failed
+        .then(() => {
+          throw new Error('the pull should have been rejected');
+        }, error => {
+          expect(error.message).toContain('could not allocate');
+          expect(errors.length).toBe(1);
+          const pending = watch.next();
+          callbacks.eventCallback(batch);
+          return pending;
+        })
+        .then(events => {
+          expect(events).toBe(batch);
+        })
+        .then(done, err => done.fail(err));
+    });
+
+    it('only pulls when asked to', function() {
+      expect(() => nsfw(workDir, null)).toThrow();
+      expect(() => nsfw(workDir, undefined, { debounceMS: DEBOUNCE })).toThrow();
+      expect(() => nsfw(workDir, () => {}, { pull: true })).toThrow();
+      expect(() => nsfw(workDir, null, { pull: 'yes' })).toThrow();
+    });
+
+    it('rejects next() on a watcher that delivers to its callback', function(done) {
+      let watch;
+
+      return nsfw(workDir, () => {}, { debounceMS: DEBOUNCE })
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => watch.next())
+        .then(() => {
+          throw new Error('next() should have been rejected');
+        }, error => {
+          expect(error.message).toContain('pull');
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+  });
+
+  describe('Binary batches', function() {
+    it('delivers events that decode to the usual objects', function(done) {
+      const inPath = path.resolve(workDir, 'test2');
+      const events = [];
+      let watch;
+
+      function handleEvents(batch) {
+        expect(Array.isArray(batch)).toBe(false);
+        batch.forEach(event => events.push(event.toObject()));
+      }
+
+      return nsfw(workDir, handleEvents, { debounceMS: DEBOUNCE, binary: true })
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => fse.writeFile(path.join(inPath, 'packed.file'), 'binary'))
+        .then(() => fse.rename(path.join(inPath, 'packed.file'), path.join(inPath, 'unpacked.file')))
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          expect(events).toContain({ action: nsfw.actions.CREATED, directory: inPath, file: 'packed.file' });
+          expect(events).toContain({
+            action: nsfw.actions.RENAMED,
+            directory: inPath,
+            oldFile: 'packed.file',
+            newFile: 'unpacked.file'
+          });
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+  });
+
+  describe('Grouped batches', function() {
+    it('groups events by directory and keeps their order', function(done) {
+      const inPath = path.resolve(workDir, 'test2');
+      const deepPath = path.resolve(workDir, 'test2', 'folder2');
+      const groups = {};
+      let watch;
+
+      function handleEvents(batch) {
+        batch.forEach(group => {
+          expect(group.events.every(event => event.directory === group.directory)).toBe(true);
+          groups[group.directory] = (groups[group.directory] || []).concat(group.events.map(event => event.file));
+        });
+      }
+
+      return nsfw(workDir, handleEvents, { debounceMS: DEBOUNCE, grouped: true })
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          for (let i = 0; i < 10; ++i) {
+            fse.writeFileSync(path.join(i % 2 ? inPath : deepPath, 'grouped' + i + '.file'), 'grouped');
+          }
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          const created = directory => groups[directory].filter((file, index, files) => files.indexOf(file) === index);
+          expect(created(deepPath)).toEqual([0, 2, 4, 6, 8].map(i => 'grouped' + i + '.file'));
+          expect(created(inPath)).toEqual([1, 3, 5, 7, 9].map(i => 'grouped' + i + '.file'));
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+
+    it('gives each directory one group when its events are interleaved with another', function(done) {
+      const inPath = path.resolve(workDir, 'test2');
+      const deepPath = path.resolve(workDir, 'test2', 'folder2');
+      const batches = [];
+      let watch;
+
+      function handleEvents(batch) {
+        batches.push(batch.map(group => group.directory));
+      }
+
+      return nsfw(workDir, handleEvents, { debounceMS: DEBOUNCE, grouped: true })
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          // inotify hands every event in a directory the same copy of its path, see the spill case below for copies
+          for (let i = 0; i < 10; ++i) {
+            fse.writeFileSync(path.join(i % 2 ? inPath : deepPath, 'interleaved' + i + '.file'), 'grouped');
+          }
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          expect(batches.length).toBeGreaterThan(0);
+          batches.forEach(directories => {
+            expect(directories.filter((directory, index) => directories.indexOf(directory) !== index)).toEqual([]);
+          });
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+
+    it('gives each directory one group when spilled events carry separate copies of its path', function(done) {
+      const inPath = path.resolve(workDir, 'test2');
+      const deepPath = path.resolve(workDir, 'test2', 'folder2');
+      const fileCount = 40;
+      const batches = [];
+      const created = [];
+      let spilled = 0;
+      let watch;
+
+      function handleEvents(batch) {
+        spilled = Math.max(spilled, watch.getStats().spilledEvents);
+        batches.push(batch.map(group => group.directory));
+        batch.forEach(group => group.events.forEach(event => {
+          if (event.action === nsfw.actions.CREATED) {
+            created.push(event.file);
+          }
+        }));
+      }
+
+      return nsfw(workDir, handleEvents, { debounceMS: 1, grouped: true, maxQueueEvents: 8, overflowPolicy: 'spill' })
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          // events read back from the spill file share a path only within a run in one directory, so every switch
+          // of directory gives the batch another copy of the same path. Blocking the loop makes the backlog spill.
+          for (let i = 0; i < fileCount; ++i) {
+            fse.writeFileSync(path.join(i % 2 ? inPath : deepPath, 'spilled' + i + '.file'), 'grouped');
+          }
+          const blockUntil = Date.now() + 500;
+          while (Date.now() < blockUntil) {} // eslint-disable-line no-empty
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          expect(created.length).toBe(fileCount);
+          expect(spilled).toBeGreaterThan(0);
+          batches.forEach(directories => {
+            expect(directories.filter((directory, index) => directories.indexOf(directory) !== index)).toEqual([]);
+          });
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+
+    it('cannot be combined with binary batches', function() {
+      expect(() => nsfw(workDir, () => {}, { grouped: true, binary: true })).toThrow();
+    });
+  });
+
+  describe('Coalescing', function() {
+    it('merges repeated modifications of a file into one event', function(done) {
+      const inPath = path.resolve(workDir, 'test2');
+      const file = 'testing2.file';
+      const writes = 20;
+      const modified = [];
+      let watch;
+
+      function handleEvents(events) {
+        events.forEach(event => {
+          if (event.action === nsfw.actions.MODIFIED && event.directory === inPath && event.file === file) {
+            modified.push(event);
+          }
+        });
+      }
+
+      return nsfw(workDir, handleEvents, { debounceMS: DEBOUNCE, coalesce: true })
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          for (let i = 0; i < writes; ++i) {
+            fse.appendFileSync(path.join(inPath, file), 'more');
+          }
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          expect(modified.length).toBeGreaterThan(0);
+          expect(modified.length).toBeLessThan(writes);
+          expect(modified.reduce((total, event) => total + (event.count || 1), 0)).toBe(writes);
+          expect(watch.getStats().coalescedEvents).toBe(writes - modified.length);
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+  });
+
+  describe('Net effect', function() {
+    const { CREATED, DELETED, MODIFIED, RENAMED } = nsfw.actions;
+    const file = 'testing2.file';
+
+    // each case runs in test2, and expects what is left of it after the batch is reduced
+    const cases = [{
+      rule: 'drops a file created and deleted in the same batch',
+      act: dir => {
+        fse.writeFileSync(path.join(dir, 'new.file'), 'new');
+        fse.unlinkSync(path.join(dir, 'new.file'));
+      },
+      expected: []
+    }, {
+      rule: 'reports a file created and then modified as created',
+      act: dir => {
+        fse.writeFileSync(path.join(dir, 'new.file'), 'new');
+        fse.appendFileSync(path.join(dir, 'new.file'), 'more');
+      },
+      expected: [{ action: CREATED, file: 'new.file' }]
+    }, {
+      rule: 'reports repeated modifications as one',
+      act: dir => {
+        for (let i = 0; i < 3; ++i) {
+          fse.appendFileSync(path.join(dir, file), 'more');
+        }
+      },
+      expected: [{ action: MODIFIED, file, count: 3 }]
+    }, {
+      rule: 'reports a file modified and then deleted as deleted',
+      act: dir => {
+        fse.appendFileSync(path.join(dir, file), 'more');
+        fse.unlinkSync(path.join(dir, file));
+      },
+      expected: [{ action: DELETED, file }]
+    }, {
+      rule: 'reports a file created and then renamed as created under its new name',
+      act: dir => {
+        fse.writeFileSync(path.join(dir, 'new.file'), 'new');
+        fse.renameSync(path.join(dir, 'new.file'), path.join(dir, 'moved.file'));
+      },
+      expected: [{ action: CREATED, file: 'moved.file' }]
+    }, {
+      rule: 'reports a chain of renames as one',
+      act: dir => {
+        fse.renameSync(path.join(dir, file), path.join(dir, 'a.file'));
+        fse.renameSync(path.join(dir, 'a.file'), path.join(dir, 'b.file'));
+      },
+      expected: [{ action: RENAMED, oldFile: file, newFile: 'b.file' }]
+    }, {
+      rule: 'drops a file renamed back to its original name',
+      act: dir => {
+        fse.renameSync(path.join(dir, file), path.join(dir, 'a.file'));
+        fse.renameSync(path.join(dir, 'a.file'), path.join(dir, file));
+      },
+      expected: []
+    }, {
+      rule: 'reports a file renamed and then deleted as deleted under its original name',
+      act: dir => {
+        fse.renameSync(path.join(dir, file), path.join(dir, 'a.file'));
+        fse.unlinkSync(path.join(dir, 'a.file'));
+      },
+      expected: [{ action: DELETED, file }]
+    }, {
+      rule: 'reports a file modified, renamed and then deleted as deleted under its original name',
+      act: dir => {
+        fse.appendFileSync(path.join(dir, file), 'more');
+        fse.renameSync(path.join(dir, file), path.join(dir, 'a.file'));
+        fse.unlinkSync(path.join(dir, 'a.file'));
+      },
+      expected: [{ action: DELETED, file }]
+    }, {
+      rule: 'reports a file modified and renamed back to its original name as modified',
+      act: dir => {
+        fse.appendFileSync(path.join(dir, file), 'more');
+        fse.renameSync(path.join(dir, file), path.join(dir, 'a.file'));
+        fse.renameSync(path.join(dir, 'a.file'), path.join(dir, file));
+      },
+      expected: [{ action: MODIFIED, file }]
+    }];
+
+    cases.forEach(({ rule, act, expected }) => {
+      it(rule, function(done) {
+        const inPath = path.resolve(workDir, 'test2');
+        const received = [];
+        let watch;
+
+        function handleEvents(events) {
+          events.forEach(event => {
+            if (event.directory === inPath) {
+              const summary = { action: event.action };
+              ['file', 'oldFile', 'newFile', 'count'].forEach(key => {
+                if (event[key] !== undefined) {
+                  summary[key] = event[key];
+                }
+              });
+              received.push(summary);
+            }
+          });
+        }
+
+        return nsfw(workDir, handleEvents, { debounceMS: DEBOUNCE, netEffect: true })
+          .then(_w => {
+            watch = _w;
+            return watch.start();
+          })
+          .then(() => new Promise(resolve => {
+            setTimeout(resolve, TIMEOUT_PER_STEP);
+          }))
+          .then(() => act(inPath))
+          .then(() => new Promise(resolve => {
+            setTimeout(resolve, TIMEOUT_PER_STEP);
+          }))
+          .then(() => {
+            expect(received).toEqual(expected);
+            return watch.stop();
+          })
+          .then(done, () =>
+            watch.stop().then((err) => done.fail(err)));
+      });
+    });
+  });
+
+  describe('Quiet periods', function() {
+    const QUIET_MS = 1500;
+
+    it('holds the events of a file until it stops changing', function(done) {
+      const inPath = path.resolve(workDir, 'test2');
+      const file = 'testing2.file';
+      const deliveries = [];
+      let lastWrite;
+      let watch;
+
+      function handleEvents(events) {
+        if (events.some(event => event.directory === inPath && event.file === file)) {
+          deliveries.push(Date.now());
+        }
+      }
+
+      return nsfw(workDir, handleEvents, { debounceMS: DEBOUNCE, quietMS: QUIET_MS })
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => new Promise(resolve => {
+          // each write lands well inside the quiet period of the one before it
+          let writes = 0;
+          const writer = setInterval(() => {
+            fse.appendFileSync(path.join(inPath, file), 'more');
+            lastWrite = Date.now();
+            if (++writes === 5) {
+              clearInterval(writer);
+              resolve();
+            }
+          }, QUIET_MS / 5);
+        }))
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, QUIET_MS + TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          expect(deliveries.length).toBe(1);
+          expect(deliveries[0]).not.toBeLessThan(lastWrite + QUIET_MS - 10);
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+
+    it('counts held events toward the queue limits', function(done) {
+      const inPath = path.resolve(workDir, 'test2');
+      const fileCount = 200;
+      let received = 0;
+      let watch;
+
+      function handleEvents(events) {
+        received += events.filter(event => event.directory === inPath).length;
+      }
+
+      return nsfw(
+        workDir,
+        handleEvents,
+        { quietMS: QUIET_MS, maxQueueEvents: 50, overflowPolicy: 'drop-newest' }
+      )
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          for (let i = 0; i < fileCount; ++i) {
+            fse.writeFileSync(path.join(inPath, 'held' + i + '.file'), 'held');
+          }
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, QUIET_MS + TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          expect(received).toBeGreaterThan(0);
+          expect(received).not.toBeGreaterThan(50);
+          expect(watch.getStats().droppedEvents).toBeGreaterThan(0);
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+
+    it('calls settledCallback once the tree has been quiet for settleMS', function(done) {
+      const inPath = path.resolve(workDir, 'test2');
+      const settled = [];
+      let received = 0;
+      let watch;
+
+      function handleEvents(events) {
+        received += events.length;
+      }
+
+      function settledCallback() {
+        settled.push(received);
+      }
+
+      return nsfw(workDir, handleEvents, { debounceMS: DEBOUNCE, settleMS: 500, settledCallback })
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          expect(settled).toEqual([]);
+          fse.appendFileSync(path.join(inPath, 'testing2.file'), 'more');
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          // it follows the callbacks for the events it waited on
+          expect(received).toBeGreaterThan(0);
+          expect(settled).toEqual([received]);
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+
+    it('needs settleMS and settledCallback together', function() {
+      expect(() => nsfw(workDir, () => {}, { settleMS: 500 })).toThrow();
+      expect(() => nsfw(workDir, () => {}, { settledCallback: () => {} })).toThrow();
+      expect(() => nsfw(workDir, () => {}, { quietMS: 0 })).toThrow();
+    });
+  });
+
+  describe('Atomic saves', function() {
+    const { MODIFIED } = nsfw.actions;
+    const file = 'testing2.file';
+
+    function saveAtomically(atomicSave, tempFile, done) {
+      const inPath = path.resolve(workDir, 'test2');
+      const received = [];
+      let watch;
+
+      function handleEvents(events) {
+        events.forEach(event => {
+          if (event.directory === inPath) {
+            received.push(event);
+          }
+        });
+      }
+
+      return nsfw(workDir, handleEvents, { debounceMS: DEBOUNCE, atomicSave })
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          fse.writeFileSync(path.join(inPath, tempFile), 'saved');
+          fse.renameSync(path.join(inPath, tempFile), path.join(inPath, file));
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          expect(received).toEqual([{ action: MODIFIED, directory: inPath, file }]);
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    }
+
+    it('reports a temp file renamed over its target as a modification of the target', function(done) {
+      return saveAtomically(true, file + '.tmp', done);
+    });
+
+    it('recognizes temp files by the patterns it is given', function(done) {
+      return saveAtomically(['.#*'], '.#' + file, done);
+    });
+
+    it('rejects patterns that are not strings', function() {
+      expect(() => nsfw(workDir, () => {}, { atomicSave: [1] })).toThrow();
+      expect(() => nsfw(workDir, () => {}, { atomicSave: '*.tmp' })).toThrow();
+    });
+  });
+
+  describe('Close-write modifications', function() {
+    // only inotify can tell a write from the close that ends it
+    const linuxIt = process.platform === 'linux' ? it : xit;
+
+    linuxIt('reports a file written in many pieces once it is closed', function(done) {
+      const inPath = path.resolve(workDir, 'test2');
+      const file = 'testing2.file';
+      const modified = [];
+      let fd;
+      let watch;
+
+      function handleEvents(events) {
+        events.forEach(event => {
+          if (event.action === nsfw.actions.MODIFIED && event.directory === inPath && event.file === file) {
+            modified.push(event);
+          }
+        });
+      }
+
+      return nsfw(workDir, handleEvents, { debounceMS: DEBOUNCE, closeWrite: true })
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          fd = fse.openSync(path.join(inPath, file), 'a');
+          for (let i = 0; i < 100; ++i) {
+            fse.writeSync(fd, 'more');
+          }
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          expect(modified.length).toBe(0);
+          fse.closeSync(fd);
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          expect(modified.length).toBe(1);
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+  });
+
+  describe('Actions', function() {
+    it('reports only the actions it is asked for', function(done) {
+      const { CREATED, DELETED } = nsfw.actions;
+      const inPath = path.resolve(workDir, 'test2');
+      const received = [];
+      let watch;
+
+      function handleEvents(events) {
+        events.forEach(event => {
+          if (event.directory === inPath) {
+            received.push({ action: event.action, file: event.file });
+          }
+        });
+      }
+
+      return nsfw(workDir, handleEvents, { debounceMS: DEBOUNCE, actions: [CREATED, DELETED] })
+        .then(_w => {
+          watch = _w;
+          return watch.start();
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          fse.writeFileSync(path.join(inPath, 'new.file'), 'new');
+          fse.appendFileSync(path.join(inPath, 'testing2.file'), 'more');
+          fse.renameSync(path.join(inPath, 'new.file'), path.join(inPath, 'renamed.file'));
+          fse.unlinkSync(path.join(inPath, 'testing2.file'));
+        })
+        .then(() => new Promise(resolve => {
+          setTimeout(resolve, TIMEOUT_PER_STEP);
+        }))
+        .then(() => {
+          expect(received).toEqual([
+            { action: CREATED, file: 'new.file' },
+            { action: DELETED, file: 'testing2.file' }
+          ]);
+          return watch.stop();
+        })
+        .then(done, () =>
+          watch.stop().then((err) => done.fail(err)));
+    });
+
+    it('rejects anything but a list of actions', function() {
+      expect(() => nsfw(workDir, () => {}, { actions: [] })).toThrow();
+      expect(() => nsfw(workDir, () => {}, { actions: ['created'] })).toThrow();
+      expect(() => nsfw(workDir, () => {}, { actions: [nsfw.actions.OVERFLOW] })).toThrow();
+    });
+  });
+
   describe('Stress', function() {
     const stressRepoPath = path.resolve('nsfw-stress-test');
 
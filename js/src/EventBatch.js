@@ -0,0 +1,126 @@
+// A batch delivered in binary mode. The native side packs it into one buffer (see NSFW::packEvents for the layout),
+// and names are only decoded from it when they are read.
+const HEADER_FIELDS = 2;
+const DIRECTORY_FIELDS = 2;
+const RECORD_FIELDS = 7;
+
+const RENAMED = 3;
+const OVERFLOW = 4;
+
+class EventBatch {
+  constructor(buffer) {
+    const { byteOffset } = buffer;
+    const header = new Uint32Array(buffer.buffer, byteOffset, HEADER_FIELDS);
+    const directoryCount = header[1];
+    const directoryTableOffset = byteOffset + HEADER_FIELDS * 4;
+    const recordsOffset = directoryTableOffset + directoryCount * DIRECTORY_FIELDS * 4;
+
+    this.length = header[0];
+    this._buffer = buffer;
+    this._directoryTable = new Uint32Array(buffer.buffer, directoryTableOffset, directoryCount * DIRECTORY_FIELDS);
+    this._records = new Uint32Array(buffer.buffer, recordsOffset, this.length * RECORD_FIELDS);
+    this._directories = new Array(directoryCount);
+  }
+
+  get(index) {
+    return new EventView(this, index);
+  }
+
+  forEach(callback) {
+    for (let i = 0; i < this.length; ++i) {
+      callback(this.get(i), i);
+    }
+  }
+
+  // The same objects a batch is made of when binary mode is off
+  toArray() {
+    const events = new Array(this.length);
+    for (let i = 0; i < this.length; ++i) {
+      events[i] = this.get(i).toObject();
+    }
+    return events;
+  }
+
+  _directory(index) {
+    // every event in a directory shares its path, so it is decoded once per batch
+    let directory = this._directories[index];
+    if (directory === undefined) {
+      const offset = this._directoryTable[index * DIRECTORY_FIELDS];
+      const length = this._directoryTable[index * DIRECTORY_FIELDS + 1];
+      directory = this._directories[index] = this._buffer.toString('utf8', offset, offset + length);
+    }
+    return directory;
+  }
+
+  _string(offset, length) {
+    return this._buffer.toString('utf8', offset, offset + length);
+  }
+}
+
+if (typeof Symbol !== 'undefined' && Symbol.iterator) {
+  EventBatch.prototype[Symbol.iterator] = function iterator() {
+    let i = 0;
+    return {
+      next: () => i < this.length ? { done: false, value: this.get(i++) } : { done: true }
+    };
+  };
+}
+
+class EventView {
+  constructor(batch, index) {
+    this._batch = batch;
+    this._record = index * RECORD_FIELDS;
+  }
+
+  get action() {
+    return this._batch._records[this._record];
+  }
+
+  get directory() {
+    return this._batch._directory(this._batch._records[this._record + 1]);
+  }
+
+  get file() {
+    const action = this.action;
+    return action === RENAMED || action === OVERFLOW ? undefined : this._fileA();
+  }
+
+  get oldFile() {
+    return this.action === RENAMED ? this._fileA() : undefined;
+  }
+
+  // Only set on a MODIFIED event that a coalescing watcher merged others into
+  get count() {
+    const count = this._batch._records[this._record + 6];
+    return count > 1 ? count : undefined;
+  }
+
+  get newFile() {
+    const records = this._batch._records;
+    return this.action === RENAMED
+      ? this._batch._string(records[this._record + 4], records[this._record + 5])
+      : undefined;
+  }
+
+  toObject() {
+    const { action, directory } = this;
+    if (action === RENAMED) {
+      return { action, directory, oldFile: this.oldFile, newFile: this.newFile };
+    } else if (action === OVERFLOW) {
+      return { action, directory };
+    }
+    const count = this.count;
+    return count === undefined ? { action, directory, file: this.file } : { action, directory, file: this.file, count };
+  }
+
+  toJSON() {
+    return this.toObject();
+  }
+
+  _fileA() {
+    const records = this._batch._records;
+    return this._batch._string(records[this._record + 2], records[this._record + 3]);
+  }
+}
+
+module.exports = EventBatch;
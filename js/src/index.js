@@ -1,16 +1,48 @@
 const { NSFW } = require('../../build/Release/nsfw.node');
+const EventBatch = require('./EventBatch');
 const fse = require('promisify-node')(require('fs-extra'));
 const path = require('path');
 const _ = require('lodash');
 
 const _private = {};
 
-function nsfw() {
+const DEBOUNCE_MODES = ['leading', 'trailing', 'both'];
+const OVERFLOW_POLICIES = ['drop-oldest', 'drop-newest', 'collapse-to-overflow', 'spill'];
+const ATOMIC_SAVE_PATTERNS = ['*.tmp', '*.temp', '*.swp', '*~'];
+
+function nsfw(debounceMS, watchPath, eventCallback, errorCallback, nativeOptions) {
   if (!(this instanceof nsfw)) {
     return _private.buildNSFW(...arguments);
   }
 
-  const _nsfw = new NSFW(...arguments);
+  // a pulling watcher answers next() calls in order, the native side delivers one batch per call
+  const pulls = [];
+  let pullError = null;
+
+  if (nativeOptions && nativeOptions.pull) {
+    const userErrorCallback = errorCallback;
+    eventCallback = events => {
+      if (pulls.length > 0) {
+        pulls.shift().resolve(events);
+      }
+    };
+    // a recoverable error only fails the pulls waiting on it, the watcher is still running for the next ones
+    errorCallback = (nsfwError, recoverable) => {
+      const error = new Error(nsfwError);
+      if (!recoverable) {
+        pullError = error;
+      }
+      pulls.splice(0).forEach(pull => pull.reject(error));
+      userErrorCallback(nsfwError);
+    };
+  }
+
+  if (nativeOptions && nativeOptions.binary) {
+    const batchCallback = eventCallback;
+    eventCallback = buffer => batchCallback(new EventBatch(buffer));
+  }
+
+  const _nsfw = new NSFW(debounceMS, watchPath, eventCallback, errorCallback, nativeOptions);
 
   this.start = function start() {
     return new Promise((resolve, reject) => {
@@ -26,19 +58,51 @@ function nsfw() {
   this.stop = function stop() {
     return new Promise(resolve => {
       _nsfw.stop(resolve);
+    }).then(() => pulls.splice(0).forEach(pull => pull.resolve(null)));
+  };
+
+  this.next = function next() {
+    if (!nativeOptions || !nativeOptions.pull) {
+      return Promise.reject(new Error('Only a watcher created with pull can use next() or events().'));
+    } else if (pullError) {
+      return Promise.reject(pullError);
+    }
+    return new Promise((resolve, reject) => {
+      pulls.push({ resolve, reject });
+      _nsfw.requestEvents();
     });
   };
+
+  this.events = function events() {
+    const iterator = {
+      next: () => this.next().then(batch => batch === null ? { done: true } : { done: false, value: batch })
+    };
+    if (typeof Symbol !== 'undefined' && Symbol.asyncIterator) {
+      iterator[Symbol.asyncIterator] = () => iterator;
+    }
+    return iterator;
+  };
+
+  this.getStats = function getStats() {
+    return _nsfw.getStats();
+  };
 }
 
 nsfw.actions = {
   CREATED: 0,
   DELETED: 1,
   MODIFIED: 2,
-  RENAMED: 3
+  RENAMED: 3,
+  OVERFLOW: 4
 };
 
 _private.buildNSFW = function buildNSFW(watchPath, eventCallback, options) {
-  let { debounceMS, errorCallback } = options || {};
+  let { debounceMS, debounceMode, errorCallback } = options || {};
+  const { debounceMinMS, debounceMaxMS, maxQueueEvents, maxQueueBytes, overflowPolicy } = options || {};
+  const { maxCallbackEvents, maxCallbackBytes, maxCallbackMS } = options || {};
+  const { binary, closeWrite, coalesce, grouped, netEffect } = options || {};
+  const { quietMS, settleMS, settledCallback } = options || {};
+  const { actions, atomicSave, pull } = options || {};
 
   if (_.isInteger(debounceMS)) {
     if (debounceMS < 1) {
@@ -50,8 +114,104 @@ _private.buildNSFW = function buildNSFW(watchPath, eventCallback, options) {
     throw new Error('Option debounceMS must be a positive integer greater than 1.');
   }
 
+  const nativeOptions = {};
+
+  if (!_.isUndefined(debounceMinMS) || !_.isUndefined(debounceMaxMS)) {
+    if (!_.isInteger(debounceMinMS) || !_.isInteger(debounceMaxMS) || debounceMinMS < 1) {
+      throw new Error('Options debounceMinMS and debounceMaxMS must both be positive integers.');
+    } else if (debounceMinMS > debounceMaxMS) {
+      throw new Error('Option debounceMinMS cannot be greater than debounceMaxMS.');
+    }
+    debounceMS = _.clamp(debounceMS, debounceMinMS, debounceMaxMS);
+    nativeOptions.debounceMinMS = debounceMinMS;
+    nativeOptions.debounceMaxMS = debounceMaxMS;
+  }
+
+  if (_.isUndefined(debounceMode)) {
+    debounceMode = 'trailing';
+  } else if (!_.includes(DEBOUNCE_MODES, debounceMode)) {
+    throw new Error('Option debounceMode must be one of \'leading\', \'trailing\' or \'both\'.');
+  }
+  nativeOptions.debounceMode = debounceMode;
+
+  const limits = { maxQueueEvents, maxQueueBytes, maxCallbackEvents, maxCallbackBytes, maxCallbackMS };
+  _.forEach(limits, (limit, name) => {
+    if (_.isUndefined(limit)) {
+      return;
+    } else if (!_.isInteger(limit) || limit < 0) {
+      throw new Error(`Option ${name} must be a non-negative integer.`);
+    }
+    nativeOptions[name] = limit;
+  });
+
+  if (!_.isUndefined(overflowPolicy)) {
+    if (!_.includes(OVERFLOW_POLICIES, overflowPolicy)) {
+      throw new Error(
+        'Option overflowPolicy must be one of \'drop-oldest\', \'drop-newest\', \'collapse-to-overflow\' or \'spill\'.'
+      );
+    }
+    nativeOptions.overflowPolicy = overflowPolicy;
+  }
+
+  _.forEach({ binary, closeWrite, coalesce, grouped, netEffect }, (flag, name) => {
+    if (_.isUndefined(flag)) {
+      return;
+    } else if (!_.isBoolean(flag)) {
+      throw new Error(`Option ${name} must be a boolean.`);
+    }
+    nativeOptions[name] = flag;
+  });
+  if (binary && grouped) {
+    throw new Error('Options binary and grouped cannot be used together.');
+  }
+
+  if (!_.isUndefined(actions)) {
+    const validActions = _.values(_.omit(nsfw.actions, 'OVERFLOW'));
+    if (!_.isArray(actions) || actions.length === 0 || !_.every(actions, action => _.includes(validActions, action))) {
+      throw new Error('Option actions must be a non-empty array of nsfw.actions other than OVERFLOW.');
+    }
+    nativeOptions.actions = actions;
+  }
+
+  if (atomicSave === true) {
+    nativeOptions.atomicSave = ATOMIC_SAVE_PATTERNS;
+  } else if (_.isArray(atomicSave) && _.every(atomicSave, pattern => _.isString(pattern) && pattern.length > 0)) {
+    nativeOptions.atomicSave = atomicSave;
+  } else if (!_.isUndefined(atomicSave) && atomicSave !== false) {
+    throw new Error('Option atomicSave must be a boolean or an array of temp name patterns.');
+  }
+
+  _.forEach({ quietMS, settleMS }, (period, name) => {
+    if (_.isUndefined(period)) {
+      return;
+    } else if (!_.isInteger(period) || period < 1) {
+      throw new Error(`Option ${name} must be a positive integer.`);
+    }
+    nativeOptions[name] = period;
+  });
+  if (_.isUndefined(settleMS) !== _.isUndefined(settledCallback)) {
+    throw new Error('Options settleMS and settledCallback must be given together.');
+  } else if (!_.isUndefined(settledCallback)) {
+    if (!_.isFunction(settledCallback)) {
+      throw new Error('Option settledCallback must be a function.');
+    }
+    nativeOptions.settledCallback = settledCallback;
+  }
+
+  if (!_.isUndefined(pull) && !_.isBoolean(pull)) {
+    throw new Error('Option pull must be a boolean.');
+  } else if (pull) {
+    if (!_.isNil(eventCallback)) {
+      throw new Error('Event callback must be null when pulling events with next() or events().');
+    }
+    nativeOptions.pull = true;
+  } else if (!_.isFunction(eventCallback)) {
+    throw new Error('Event callback must be a function.');
+  }
+
   if (_.isUndefined(errorCallback)) {
-    errorCallback = function(nsfwError) {
+    // a pulling consumer hears about errors through the promise it is waiting on
+    errorCallback = pull ? _.noop : function(nsfwError) {
       throw nsfwError;
     };
   }
@@ -63,9 +223,29 @@ _private.buildNSFW = function buildNSFW(watchPath, eventCallback, options) {
   return fse.stat(watchPath)
     .then(stats => {
       if (stats.isDirectory()) {
-        return new nsfw(debounceMS, watchPath, eventCallback, errorCallback);
+        return new nsfw(debounceMS, watchPath, eventCallback, errorCallback, nativeOptions);
       } else if (stats.isFile()) {
-        return new _private.nsfwFilePoller(debounceMS, watchPath, eventCallback);
+        if (pull) {
+          throw new Error('Pulling events is only supported when watching a directory.');
+        } else if (binary) {
+          throw new Error('Binary batches are only supported when watching a directory.');
+        } else if (quietMS || settleMS) {
+          throw new Error('Quiet periods are only supported when watching a directory.');
+        }
+        // a single file is always a single group
+        let fileCallback = grouped
+          ? events => eventCallback([{ directory: path.dirname(watchPath), events }])
+          : eventCallback;
+        if (actions) {
+          const reportedCallback = fileCallback;
+          fileCallback = events => {
+            const reported = events.filter(event => _.includes(actions, event.action));
+            if (reported.length > 0) {
+              reportedCallback(reported);
+            }
+          };
+        }
+        return new _private.nsfwFilePoller(debounceMS, watchPath, fileCallback);
       } else {
         throw new Error('Path must be a valid path to a file or a directory.');
       }
@@ -117,6 +297,10 @@ _private.nsfwFilePoller = function(debounceMS, watchPath, eventCallback) {
     return Promise.resolve()
       .then(() => clearInterval(filePollerInterval));
   };
+
+  this.getStats = function getStats() {
+    return { debounceMS };
+  };
 };
 
 module.exports = nsfw;
@@ -0,0 +1,114 @@
+#include "../includes/AtomicSave.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#pragma unmanaged
+AtomicSave::AtomicSave(const std::vector<std::string> &patterns):
+  mPatterns(patterns) {}
+
+void AtomicSave::reduce(std::vector<Event *> &events) {
+  // the events of each temp file created in this batch, and the last deletion of each other path
+  std::unordered_map<std::string, std::vector<size_t> > temps;
+  std::unordered_map<std::string, size_t> deletions;
+  bool reduced = false;
+
+  for (size_t i = 0; i < events.size(); ++i) {
+    Event *event = events[i];
+    switch (event->type) {
+      case OVERFLOWED:
+        temps.clear();
+        deletions.clear();
+        break;
+
+      case CREATED:
+        if (isTemp(event->fileA(), event->fileALength)) {
+          temps[event->keyA()].assign(1, i);
+        } else {
+          deletions.erase(event->keyA());
+        }
+        break;
+
+      case MODIFIED: {
+        auto temp = temps.find(event->keyA());
+        if (temp != temps.end()) {
+          temp->second.push_back(i);
+        }
+        break;
+      }
+
+      case DELETED:
+        if (isTemp(event->fileA(), event->fileALength)) {
+          temps.erase(event->keyA());
+        } else {
+          deletions[event->keyA()] = i;
+        }
+        break;
+
+      case RENAMED: {
+        std::string target = event->keyB();
+        auto temp = temps.find(event->keyA());
+        if (temp == temps.end() || isTemp(event->fileB(), event->fileBLength)) {
+          temps.erase(event->keyA());
+          deletions.erase(target);
+          break;
+        }
+
+        for (auto index = temp->second.begin(); index != temp->second.end(); ++index) {
+          delete events[*index];
+          events[*index] = NULL;
+        }
+        temps.erase(temp);
+
+        auto deletion = deletions.find(target);
+        if (deletion != deletions.end()) {
+          delete events[deletion->second];
+          events[deletion->second] = NULL;
+          deletions.erase(deletion);
+        }
+
+        events[i] = Event::create(MODIFIED, event->directory, StringView(event->fileB(), event->fileBLength));
+        delete event;
+        reduced = true;
+        break;
+      }
+    }
+  }
+
+  if (reduced) {
+    events.erase(std::remove(events.begin(), events.end(), (Event *)NULL), events.end());
+  }
+}
+
+bool AtomicSave::isTemp(const char *name, size_t length) const {
+  for (auto pattern = mPatterns.begin(); pattern != mPatterns.end(); ++pattern) {
+    if (matches(*pattern, name, length)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Backtracks to the last * on a mismatch, which is linear for patterns with one * and never worse than quadratic
+bool AtomicSave::matches(const std::string &pattern, const char *name, size_t length) {
+  size_t p = 0, n = 0, star = std::string::npos, resume = 0;
+  while (n < length) {
+    if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+      ++p;
+      ++n;
+    } else if (p < pattern.size() && pattern[p] == '*') {
+      star = p++;
+      resume = n;
+    } else if (star != std::string::npos) {
+      p = star + 1;
+      n = ++resume;
+    } else {
+      return false;
+    }
+  }
+
+  while (p < pattern.size() && pattern[p] == '*') {
+    ++p;
+  }
+  return p == pattern.size();
+}
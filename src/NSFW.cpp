@@ -1,50 +1,252 @@
 #include "../includes/NSFW.h"
 
-#if defined(_WIN32)
-#include <windows.h>
-#define sleep_for_ms(ms) Sleep(ms)
-#else
-#include <unistd.h>
-#define sleep_for_ms(ms) usleep(ms * 1000)
-#endif
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+// An adaptive debounce window doubles when it collects events faster than the burst rate and halves when it sees
+// fewer than the quiet rate, in events per second.
+#define ADAPTIVE_BURST_RATE 200
+#define ADAPTIVE_QUIET_RATE 20
+
+#define BINARY_RECORD_FIELDS 7
 
 #pragma unmanaged
 Persistent<v8::Function> NSFW::constructor;
+NSFW::EventShapes NSFW::eventShapes;
+
+static v8::Local<v8::Value> getOption(v8::Local<v8::Object> options, const char *name) {
+  return options->Get(New<v8::String>(name).ToLocalChecked());
+}
+
+// Leaves value alone when the option is not set, returns false when it is set to something other than a uint32
+static bool getUint32Option(v8::Local<v8::Object> options, const char *name, uint32_t &value) {
+  v8::Local<v8::Value> optionValue = getOption(options, name);
+  if (optionValue->IsUndefined()) {
+    return true;
+  }
+  if (!optionValue->IsUint32()) {
+    return false;
+  }
+  value = optionValue->Uint32Value();
+  return true;
+}
+
+static v8::Local<v8::String> internalize(const char *name) {
+  return v8::String::NewFromUtf8(v8::Isolate::GetCurrent(), name, v8::NewStringType::kInternalized).ToLocalChecked();
+}
+
+static std::string toUtf8(v8::Local<v8::Value> value) {
+  v8::String::Utf8Value utf8Value(value->ToString());
+  return std::string(*utf8Value);
+}
 
-NSFW::NSFW(uint32_t debounceMS, std::string path, Callback *eventCallback, Callback *errorCallback):
+NSFW::NSFW(
+  uint32_t debounceMS,
+  uint32_t debounceMinMS,
+  uint32_t debounceMaxMS,
+  DebounceMode debounceMode,
+  QueueCapacity queueCapacity,
+  WatchOptions watchOptions,
+  CallbackLimits callbackLimits,
+  uint32_t quietMS,
+  uint32_t settleMS,
+  BatchFormat batchFormat,
+  const std::vector<std::string> &atomicSavePatterns,
+  bool coalesce,
+  bool netEffect,
+  bool pull,
+  std::string path,
+  Callback *eventCallback,
+  Callback *errorCallback,
+  Callback *settledCallback
+):
+  mAtomicSave(atomicSavePatterns.empty() ? NULL : new AtomicSave(atomicSavePatterns)),
+  mBatchFormat(batchFormat),
+  mCallbackLimits(callbackLimits),
+  mCoalesce(coalesce),
+  mDebounceMaxMS(debounceMaxMS),
+  mDebounceMinMS(debounceMinMS),
+  mDebounceMode(debounceMode),
   mDebounceMS(debounceMS),
   mErrorCallback(errorCallback),
   mEventCallback(eventCallback),
   mInterface(NULL),
   mInterfaceLockValid(false),
+  mNetEffect(netEffect ? new NetEffect : NULL),
   mPath(path),
-  mRunning(false) {
+  mPull(pull),
+  mPulls(0),
+  mQueueCapacity(queueCapacity),
+  mQuiescence(quietMS != 0 ? new Quiescence(quietMS) : NULL),
+  mRunning(false),
+  mSettledCallback(settledCallback),
+  mSettleMS(settleMS),
+  mUnsettled(false),
+  mWatchOptions(watchOptions),
+  mPartialBaton(NULL) {
     HandleScope scope;
     v8::Local<v8::Object> obj = New<v8::Object>();
     mPersistentHandle.Reset(obj);
     mInterfaceLockValid = uv_mutex_init(&mInterfaceLock) == 0;
+    OPA_store_int(&mEffectiveDebounceMS, debounceMS);
+    OPA_Queue_init(&mEventBatons);
+    OPA_store_int(&mDemand, 0);
+    OPA_store_int(&mPendingBatons, 0);
   }
 
 NSFW::~NSFW() {
   if (mInterface != NULL) {
     delete mInterface;
   }
+  delete mAtomicSave;
+  delete mNetEffect;
+  delete mQuiescence;
   delete mEventCallback;
   delete mErrorCallback;
+  delete mSettledCallback;
 
   if (mInterfaceLockValid) {
     uv_mutex_destroy(&mInterfaceLock);
   }
 }
 
-void NSFW::cleanupEventCallback(void *arg) {
-  EventBaton *baton = (EventBaton *)arg;
-  for (uint32_t i = 0; i < baton->events->size(); ++i) {
-    delete (*baton->events)[i];
-    (*baton->events)[i] = NULL;
+void NSFW::adaptDebounce(uint32_t eventCount, uint64_t elapsedNS) {
+  if (mDebounceMinMS == mDebounceMaxMS) {
+    return;
   }
-  delete baton->events;
-  delete baton;
+
+  uint64_t window = OPA_load_int(&mEffectiveDebounceMS);
+  uint64_t elapsedMS = std::max<uint64_t>(elapsedNS / 1000000, 1);
+  uint64_t eventsPerSecond = (uint64_t)eventCount * 1000 / elapsedMS;
+
+  if (eventsPerSecond >= ADAPTIVE_BURST_RATE) {
+    window = std::min<uint64_t>(window * 2, mDebounceMaxMS);
+  } else if (eventsPerSecond <= ADAPTIVE_QUIET_RATE) {
+    // every window's worth of quiet halves the window, measured against the window as it shrinks, so a quiet period
+    // twice as long as the window brings it right back down
+    for (uint64_t quietMS = elapsedMS; quietMS >= window && window > mDebounceMinMS; ) {
+      quietMS -= window;
+      window = std::max<uint64_t>(window / 2, mDebounceMinMS);
+    }
+  }
+
+  OPA_store_int(&mEffectiveDebounceMS, (int)window);
+}
+
+// Hands the interface's error to the JS thread and stops polling, returns whether there was one
+bool NSFW::checkForError() {
+  if (!mInterface->hasErrored()) {
+    return false;
+  }
+
+  ErrorBaton *baton = new ErrorBaton;
+  baton->nsfw = this;
+  baton->error = mInterface->getError();
+
+  mErrorCallbackAsync.data = (void *)baton;
+  uv_async_send(&mErrorCallbackAsync);
+  mRunning = false;
+  return true;
+}
+
+uint32_t NSFW::deliverEvents() {
+  // events wait in the native queue until JS is ready for them, the JS thread wakes us when that changes
+  while (!readyForEvents()) {
+    if (!mRunning || mInterface->hasErrored()) {
+      return 0;
+    }
+    mInterface->pause(OPA_load_int(&mEffectiveDebounceMS));
+  }
+
+  std::vector<Event *> *events = mInterface->getEvents();
+  if (events == NULL) {
+    return 0;
+  }
+
+  // the debounce adapts to what the watcher collected, not to what was left after reducing it
+  uint32_t collected = (uint32_t)events->size();
+  mUnsettled = true;
+  handOver(events);
+  return collected;
+}
+
+// Reduces the batch if asked to and passes it to the JS thread, which owns it from here on. Atomic saves go first, so
+// the net effect sees a save as the modification it is.
+void NSFW::handOver(std::vector<Event *> *events) {
+  if (mAtomicSave != NULL) {
+    mAtomicSave->reduce(*events);
+  }
+  if (mNetEffect != NULL) {
+    mNetEffect->reduce(*events);
+  }
+  if (events->empty()) {
+    delete events;
+    return;
+  }
+
+  if (mPull) {
+    OPA_decr_int(&mDemand);
+  }
+
+  EventBaton *baton = new EventBaton;
+  OPA_Queue_header_init(&baton->header);
+  baton->nsfw = this;
+  baton->events = events;
+  baton->delivered = 0;
+  baton->settled = false;
+
+  OPA_incr_int(&mPendingBatons);
+  OPA_Queue_enqueue(&mEventBatons, baton, EventBaton, header);
+  uv_async_send(&mEventCallbackAsync);
+}
+
+// A pulling watcher delivers a batch per outstanding request, and a bounded one only hands over a batch once the
+// previous one is consumed, otherwise the backlog would pile up in batons beyond the reach of the queue's limits
+bool NSFW::readyForEvents() {
+  if (mPull) {
+    return OPA_load_int(&mDemand) > 0;
+  }
+  if (mQueueCapacity.events != 0 || mQueueCapacity.bytes != 0) {
+    return OPA_load_int(&mPendingBatons) == 0;
+  }
+  return true;
+}
+
+// The tree has settled once it has gone mSettleMS without events and everything collected before that has been
+// handed over. The notice queues behind the batches, so JS hears of it after their callbacks.
+void NSFW::settle(uint64_t idleSince) {
+  if (
+    mSettledCallback == NULL ||
+    !mUnsettled ||
+    uv_hrtime() < idleSince + (uint64_t)mSettleMS * 1000000 ||
+    mInterface->getQueuedEventCount() > 0 ||
+    (mQuiescence != NULL && !mQuiescence->empty())
+  ) {
+    return;
+  }
+  mUnsettled = false;
+
+  EventBaton *baton = new EventBaton;
+  OPA_Queue_header_init(&baton->header);
+  baton->nsfw = this;
+  baton->events = new std::vector<Event *>;
+  baton->delivered = 0;
+  baton->settled = true;
+
+  OPA_incr_int(&mPendingBatons);
+  OPA_Queue_enqueue(&mEventBatons, baton, EventBaton, header);
+  uv_async_send(&mEventCallbackAsync);
+}
+
+// How long the poll thread may wait for events before the tree could count as settled, 0 for as long as it takes
+uint32_t NSFW::settleTimeout(uint64_t idleSince) {
+  if (mSettledCallback == NULL || !mUnsettled) {
+    return 0;
+  }
+  uint64_t settleAt = idleSince + (uint64_t)mSettleMS * 1000000, now = uv_hrtime();
+  return now >= settleAt ? 1 : (uint32_t)((settleAt - now + 999999) / 1000000);
 }
 
 void NSFW::fireErrorCallback(uv_async_t *handle) {
@@ -58,84 +260,455 @@ void NSFW::fireErrorCallback(uv_async_t *handle) {
 }
 
 void NSFW::fireEventCallback(uv_async_t *handle) {
-  Nan::HandleScope scope;
-  EventBaton *baton = (EventBaton *)handle->data;
-  if (baton->events->empty()) {
-    uv_thread_t cleanup;
-    uv_thread_create(&cleanup, NSFW::cleanupEventCallback, baton);
-    return;
+  ((NSFW *)handle->data)->drainEventBatons(false);
+}
+
+// uv_async_send coalesces, so a single call may have several batches waiting for it. Chunked delivery gives the
+// event loop a turn between chunks unless we are flushing for stop, and a pulling watcher hands over one chunk per
+// outstanding pull.
+void NSFW::drainEventBatons(bool flushing) {
+  bool chunked = mCallbackLimits.events != 0 || mCallbackLimits.bytes != 0 || mCallbackLimits.ms != 0;
+  bool delivered = false, finished = false;
+
+  while (true) {
+    if (mPartialBaton == NULL) {
+      if (OPA_Queue_is_empty(&mEventBatons)) {
+        break;
+      }
+
+      // a settled notice answers no pull, it only waits for the batches ahead of it
+      EventBaton *next = (EventBaton *)OPA_Queue_peek_head(&mEventBatons);
+      if (next->settled) {
+        OPA_Queue_dequeue(&mEventBatons, next, EventBaton, header);
+        OPA_decr_int(&mPendingBatons);
+        freeEventBaton(next);
+        mSettledCallback->Call(0, NULL);
+        finished = true;
+        continue;
+      }
+
+      if (mPull && mPulls == 0) {
+        break;
+      }
+      OPA_Queue_dequeue(&mEventBatons, mPartialBaton, EventBaton, header);
+    } else if (mPull && mPulls == 0) {
+      break;
+    }
+
+    if (delivered && chunked && !flushing) {
+      uv_async_send(&mEventCallbackAsync);
+      break;
+    }
+
+    bool handedOver = callEventCallback(mPartialBaton);
+    delivered = true;
+    if (mPull && handedOver) {
+      --mPulls;
+    } else if (mPull) {
+      // the error rejected every outstanding pull, so none of them is left to answer or hand over a batch for
+      mPulls = 0;
+      OPA_store_int(&mDemand, 0);
+    }
+
+    if (mPartialBaton->delivered == mPartialBaton->events->size()) {
+      OPA_decr_int(&mPendingBatons);
+      freeEventBaton(mPartialBaton);
+      mPartialBaton = NULL;
+      finished = true;
+    }
   }
 
-  std::vector< v8::Local<v8::Object> > *jsEventObjects = new std::vector< v8::Local<v8::Object> >;
-  jsEventObjects->reserve(baton->events->size());
+  // a bounded watcher's poll thread waits for us to catch up before it hands over another batch
+  if (finished && (mQueueCapacity.events != 0 || mQueueCapacity.bytes != 0)) {
+    uv_mutex_lock(&mInterfaceLock);
+    if (mInterface != NULL) {
+      mInterface->wake();
+    }
+    uv_mutex_unlock(&mInterfaceLock);
+  }
+}
 
+void NSFW::discardEventBatons() {
+  while (mPartialBaton != NULL || !OPA_Queue_is_empty(&mEventBatons)) {
+    if (mPartialBaton == NULL) {
+      OPA_Queue_dequeue(&mEventBatons, mPartialBaton, EventBaton, header);
+    }
+    OPA_decr_int(&mPendingBatons);
+    freeEventBaton(mPartialBaton);
+    mPartialBaton = NULL;
+  }
+}
+
+// Events go back to their pools, which is cheap enough to do right here on the loop
+void NSFW::freeEventBaton(EventBaton *baton) {
   for (auto i = baton->events->begin(); i != baton->events->end(); ++i) {
-    v8::Local<v8::Object> anEvent = New<v8::Object>();
+    delete *i;
+  }
+  delete baton->events;
+  delete baton;
+}
 
-    anEvent->Set(New<v8::String>("action").ToLocalChecked(), New<v8::Number>((*i)->type));
-    anEvent->Set(New<v8::String>("directory").ToLocalChecked(), New<v8::String>((*i)->directory).ToLocalChecked());
+// Delivers the next chunk of the baton, as much of it as mCallbackLimits allows but always at least one event.
+// Returns false when the chunk could not be built and the error callback was called instead.
+bool NSFW::callEventCallback(EventBaton *baton) {
+  Nan::HandleScope scope;
+  if (baton->delivered == baton->events->size()) {
+    return true;
+  }
 
-    if ((*i)->type == RENAMED) {
-      anEvent->Set(New<v8::String>("oldFile").ToLocalChecked(), New<v8::String>((*i)->fileA).ToLocalChecked());
-      anEvent->Set(New<v8::String>("newFile").ToLocalChecked(), New<v8::String>((*i)->fileB).ToLocalChecked());
-    } else {
-      anEvent->Set(New<v8::String>("file").ToLocalChecked(), New<v8::String>((*i)->fileA).ToLocalChecked());
+  EventIterator begin = baton->events->begin() + baton->delivered, end = begin;
+  uint32_t chunkBytes = 0, chunkEvents = 0;
+  for (; end != baton->events->end(); ++end, ++chunkEvents) {
+    uint32_t eventBytes = (uint32_t)((*end)->directory->size() + (*end)->fileALength + (*end)->fileBLength);
+    if (chunkEvents > 0 && (
+      (mCallbackLimits.events != 0 && chunkEvents >= mCallbackLimits.events) ||
+      (mCallbackLimits.bytes != 0 && chunkBytes + eventBytes > mCallbackLimits.bytes)
+    )) {
+      break;
     }
+    chunkBytes += eventBytes;
+  }
 
-    jsEventObjects->push_back(anEvent);
+  // the time limit is on building the chunk, so each format cuts end short itself once it runs out
+  uint64_t deadline = mCallbackLimits.ms == 0 ? 0 : uv_hrtime() + (uint64_t)mCallbackLimits.ms * 1000000;
+  v8::Local<v8::Value> batch;
+  if (mBatchFormat == BATCH_BINARY) {
+    batch = packEvents(begin, end, deadline);
+  } else if (mBatchFormat == BATCH_GROUPED) {
+    batch = groupEvents(begin, end, deadline);
+  } else {
+    batch = toEventObjects(begin, end, deadline);
   }
 
-  v8::Local<v8::Array> eventArray = New<v8::Array>((int)jsEventObjects->size());
+  baton->delivered += end - begin;
 
-  for (unsigned int i = 0; i < jsEventObjects->size(); ++i) {
-    eventArray->Set(i, (*jsEventObjects)[i]);
+  // only the binary mode allocates outside the V8 heap, and there is nothing to hand over when that fails. The
+  // watcher keeps running, which the second argument tells a pulling watcher's error handler.
+  if (batch.IsEmpty()) {
+    v8::Local<v8::Value> argv[] = {
+      New<v8::String>("NSFW could not allocate a binary batch, its events were discarded.").ToLocalChecked(),
+      Nan::True()
+    };
+    baton->nsfw->mErrorCallback->Call(2, argv);
+    return false;
   }
 
   v8::Local<v8::Value> argv[] = {
-    eventArray
+    batch
   };
 
   baton->nsfw->mEventCallback->Call(1, argv);
+  return true;
+}
+
+static bool pastDeadline(uint64_t deadline) {
+  return deadline != 0 && uv_hrtime() >= deadline;
+}
+
+static v8::Local<v8::Array> toArray(std::vector< v8::Local<v8::Value> > &elements) {
+#if V8_MAJOR_VERSION >= 7
+  return v8::Array::New(v8::Isolate::GetCurrent(), &elements[0], elements.size());
+#else
+  v8::Local<v8::Array> array = New<v8::Array>((int)elements.size());
+  for (uint32_t i = 0; i < elements.size(); ++i) {
+    array->Set(i, elements[i]);
+  }
+  return array;
+#endif
+}
+
+// Lays a chunk out for the binary mode, all integers are uint32 in host byte order:
+//   header      count, directory count
+//   directories offset and length of each distinct directory
+//   records     action, directory index, file A offset, file A length, file B offset, file B length, count, for each
+//               event
+//   strings     UTF-8 names the offsets above point into, from the start of the buffer
+// Events from one directory share its path, so each directory is written once however many events it has, even when
+// they were queued with separate copies of it.
+v8::Local<v8::Value> NSFW::packEvents(EventIterator begin, EventIterator &end, uint64_t deadline) {
+  std::unordered_map<std::string, uint32_t> directoryIndexes;
+  std::vector<const std::string *> directories;
+  std::vector<uint32_t> eventDirectories;
+  size_t stringBytes = 0;
+  eventDirectories.reserve(end - begin);
+
+  const std::string *lastDirectory = NULL;
+  uint32_t lastIndex = 0;
+  for (auto i = begin; i != end; ++i) {
+    if (i != begin && pastDeadline(deadline)) {
+      end = i;
+      break;
+    }
+
+    const std::string *directory = (*i)->directory.get();
+    if (directory != lastDirectory) {
+      auto found = directoryIndexes.find(*directory);
+      if (found == directoryIndexes.end()) {
+        found = directoryIndexes.insert(std::make_pair(*directory, (uint32_t)directories.size())).first;
+        directories.push_back(directory);
+        stringBytes += directory->size();
+      }
+      lastDirectory = directory;
+      lastIndex = found->second;
+    }
+    eventDirectories.push_back(lastIndex);
+    stringBytes += (*i)->fileALength + (*i)->fileBLength;
+  }
+
+  size_t count = end - begin;
+  size_t length = sizeof(uint32_t) * (2 + 2 * directories.size() + BINARY_RECORD_FIELDS * count) + stringBytes;
+  char *data = (char *)malloc(length);
+  if (data == NULL) {
+    return v8::Local<v8::Value>();
+  }
+  uint32_t *header = (uint32_t *)data;
+  uint32_t *directoryTable = header + 2;
+  uint32_t *record = directoryTable + 2 * directories.size();
+  char *strings = (char *)(record + BINARY_RECORD_FIELDS * count);
+
+  header[0] = (uint32_t)count;
+  header[1] = (uint32_t)directories.size();
+
+  for (auto i = directories.begin(); i != directories.end(); ++i) {
+    *directoryTable++ = (uint32_t)(strings - data);
+    *directoryTable++ = (uint32_t)(*i)->size();
+    memcpy(strings, (*i)->data(), (*i)->size());
+    strings += (*i)->size();
+  }
+
+  for (auto i = begin; i != end; ++i, record += BINARY_RECORD_FIELDS) {
+    Event *event = *i;
+    record[0] = event->type;
+    record[1] = eventDirectories[i - begin];
+    record[2] = (uint32_t)(strings - data);
+    record[3] = event->fileALength;
+    memcpy(strings, event->fileA(), event->fileALength);
+    strings += event->fileALength;
+    record[4] = (uint32_t)(strings - data);
+    record[5] = event->fileBLength;
+    memcpy(strings, event->fileB(), event->fileBLength);
+    strings += event->fileBLength;
+    record[6] = event->count;
+  }
+
+  // the buffer takes ownership of data and frees it once JS lets go of the batch
+  return NewBuffer(data, (uint32_t)length).ToLocalChecked();
+}
 
-  delete jsEventObjects;
+// Directories are listed in the order their first event arrived, and each keeps its own events in order. Groups are
+// keyed by the path itself, since events from one directory can hold separate copies of it.
+v8::Local<v8::Value> NSFW::groupEvents(EventIterator begin, EventIterator &end, uint64_t deadline) {
+  EventObjectBuilder builder;
+  std::unordered_map<std::string, size_t> groupIndexes;
+  std::vector<v8::Local<v8::String> > groupDirectories;
+  std::vector< std::vector< v8::Local<v8::Value> > > eventsByGroup;
+
+  const std::string *lastDirectory = NULL;
+  size_t lastIndex = 0;
+  for (auto i = begin; i != end; ++i) {
+    if (i != begin && pastDeadline(deadline)) {
+      end = i;
+      break;
+    }
+
+    const std::string *directory = (*i)->directory.get();
+    if (directory != lastDirectory) {
+      auto found = groupIndexes.find(*directory);
+      if (found == groupIndexes.end()) {
+        found = groupIndexes.insert(std::make_pair(*directory, groupDirectories.size())).first;
+        groupDirectories.push_back(builder.directory(directory));
+        eventsByGroup.push_back(std::vector< v8::Local<v8::Value> >());
+      }
+      lastDirectory = directory;
+      lastIndex = found->second;
+    }
+    eventsByGroup[lastIndex].push_back(builder.event(*i, groupDirectories[lastIndex]));
+  }
+
+  v8::Local<v8::String> directoryKey = New(eventShapes.directory);
+  v8::Local<v8::String> eventsKey = New(eventShapes.events);
+  v8::Local<v8::Object> groupShape = New(eventShapes.group);
+
+  std::vector< v8::Local<v8::Value> > groups;
+  groups.reserve(groupDirectories.size());
+  for (size_t i = 0; i < groupDirectories.size(); ++i) {
+    v8::Local<v8::Object> group = groupShape->Clone();
+    group->Set(directoryKey, groupDirectories[i]);
+    group->Set(eventsKey, toArray(eventsByGroup[i]));
+    groups.push_back(group);
+  }
+
+  return toArray(groups);
+}
+
+v8::Local<v8::Value> NSFW::toEventObjects(EventIterator begin, EventIterator &end, uint64_t deadline) {
+  EventObjectBuilder builder;
+  std::vector< v8::Local<v8::Value> > elements;
+  elements.reserve(end - begin);
+
+  for (auto i = begin; i != end; ++i) {
+    if (i != begin && pastDeadline(deadline)) {
+      end = i;
+      break;
+    }
+    elements.push_back(builder.event(*i, builder.directory((*i)->directory.get())));
+  }
 
-  uv_thread_t cleanup;
-  uv_thread_create(&cleanup, NSFW::cleanupEventCallback, baton);
+  return toArray(elements);
 }
 
+// Every event object is cloned from one of the shapes built in Init, so a batch shares their hidden classes and only
+// ever stores values into fields that already exist
+NSFW::EventObjectBuilder::EventObjectBuilder():
+  mActionKey(New(eventShapes.action)),
+  mDirectoryKey(New(eventShapes.directory)),
+  mFileKey(New(eventShapes.file)),
+  mOldFileKey(New(eventShapes.oldFile)),
+  mNewFileKey(New(eventShapes.newFile)),
+  mChange(New(eventShapes.change)),
+  mCoalesced(New(eventShapes.coalesced)),
+  mCountKey(New(eventShapes.count)),
+  mOverflow(New(eventShapes.overflow)),
+  mRename(New(eventShapes.rename)),
+  mLastDirectory(NULL) {}
+
+// Events in one directory share its string. A directory the queue saw again after another one comes with its own copy
+// of the path, so the cache is keyed by contents and the pointer only skips the lookup for runs of one directory.
+v8::Local<v8::String> NSFW::EventObjectBuilder::directory(const std::string *directory) {
+  if (directory != mLastDirectory) {
+    auto found = mDirectories.find(*directory);
+    if (found == mDirectories.end()) {
+      v8::Local<v8::String> directoryString = New<v8::String>(*directory).ToLocalChecked();
+      found = mDirectories.insert(std::make_pair(*directory, directoryString)).first;
+    }
+    mLastDirectory = directory;
+    mLastDirectoryString = found->second;
+  }
+  return mLastDirectoryString;
+}
+
+v8::Local<v8::Object> NSFW::EventObjectBuilder::event(Event *event, v8::Local<v8::String> directory) {
+  v8::Local<v8::Object> anEvent;
+  if (event->type == RENAMED) {
+    anEvent = mRename->Clone();
+    anEvent->Set(mOldFileKey, New<v8::String>(event->fileA(), event->fileALength).ToLocalChecked());
+    anEvent->Set(mNewFileKey, New<v8::String>(event->fileB(), event->fileBLength).ToLocalChecked());
+  } else if (event->type == OVERFLOWED) {
+    anEvent = mOverflow->Clone();
+  } else if (event->count > 1) {
+    anEvent = mCoalesced->Clone();
+    anEvent->Set(mFileKey, New<v8::String>(event->fileA(), event->fileALength).ToLocalChecked());
+    anEvent->Set(mCountKey, New<v8::Number>(event->count));
+  } else {
+    anEvent = mChange->Clone();
+    anEvent->Set(mFileKey, New<v8::String>(event->fileA(), event->fileALength).ToLocalChecked());
+  }
+  anEvent->Set(mActionKey, New<v8::Number>(event->type));
+  anEvent->Set(mDirectoryKey, directory);
+  return anEvent;
+}
+
+// The poll thread does not take mInterfaceLock: StopWorker only clears and deletes mInterface after joining this
+// thread. Every wait below is cut short by NativeInterface::interrupt, and only waits for JS by wake.
 void NSFW::pollForEvents(void *arg) {
   NSFW *nsfw = (NSFW *)arg;
+  if (nsfw->mQuiescence != NULL) {
+    nsfw->pollQuietly();
+    return;
+  }
+
+  bool windowOpen = false;
+  uint64_t idleSince = uv_hrtime(), windowStart = 0;
   while(nsfw->mRunning) {
-    uv_mutex_lock(&nsfw->mInterfaceLock);
+    if (nsfw->checkForError()) {
+      break;
+    }
 
-    if (nsfw->mInterface->hasErrored()) {
-      ErrorBaton *baton = new ErrorBaton;
-      baton->nsfw = nsfw;
-      baton->error = nsfw->mInterface->getError();
+    if (windowOpen) {
+      // the window has elapsed: trailing and both deliver what it collected and go idle, while leading keeps
+      // throttling until a whole window passes without events
+      uint32_t collected = nsfw->deliverEvents();
+      uint64_t now = uv_hrtime();
+      nsfw->adaptDebounce(collected, now - windowStart);
+
+      windowOpen = collected > 0 && nsfw->mDebounceMode == DEBOUNCE_LEADING;
+      windowStart = now;
+      idleSince = now;
+    } else if (nsfw->mInterface->waitForEvents(nsfw->settleTimeout(idleSince))) {
+      // the first event after an idle period opens a window, leading and both deliver it right away
+      windowStart = uv_hrtime();
+      nsfw->adaptDebounce(0, windowStart - idleSince);
+
+      if (nsfw->mDebounceMode != DEBOUNCE_TRAILING) {
+        nsfw->deliverEvents();
+      }
+      windowOpen = true;
+    } else {
+      nsfw->settle(idleSince);
+    }
 
-      nsfw->mErrorCallbackAsync.data = (void *)baton;
-      uv_async_send(&nsfw->mErrorCallbackAsync);
-      nsfw->mRunning = false;
-      uv_mutex_unlock(&nsfw->mInterfaceLock);
-      break;
+    if (windowOpen && nsfw->mRunning) {
+      nsfw->mInterface->sleep(OPA_load_int(&nsfw->mEffectiveDebounceMS));
     }
-    std::vector<Event *> *events = nsfw->mInterface->getEvents();
-    if (events == NULL) {
-      uv_mutex_unlock(&nsfw->mInterfaceLock);
-      sleep_for_ms(50);
-      continue;
+  }
+}
+
+// With a quiet period there is no debounce window. The queue is drained onto the wheel whenever events arrive, and
+// what is held counts toward the queue's limits. Paths are released as they come due once JS is ready for them.
+// Whatever is still held when the watcher stops is handed over then.
+void NSFW::pollQuietly() {
+  uint64_t idleSince = uv_hrtime();
+  while (mRunning && !checkForError()) {
+    std::vector<Event *> *events = mInterface->getEvents();
+    bool took = events != NULL;
+    uint64_t now = uv_hrtime();
+    if (took) {
+      mQuiescence->hold(*events, now / 1000000);
+      delete events;
+      mUnsettled = true;
+      idleSince = now;
     }
 
-    EventBaton *baton = new EventBaton;
-    baton->nsfw = nsfw;
-    baton->events = events;
+    if (readyForEvents()) {
+      std::vector<Event *> *released = new std::vector<Event *>;
+      mQuiescence->release(now / 1000000, *released);
+      if (released->empty()) {
+        delete released;
+      } else {
+        handOver(released);
+      }
+    }
+    mInterface->setHeldEvents(mQuiescence->heldEvents(), mQuiescence->heldBytes());
+    settle(idleSince);
 
-    nsfw->mEventCallbackAsync.data = (void *)baton;
-    uv_async_send(&nsfw->mEventCallbackAsync);
+    if (!mRunning) {
+      break;
+    }
 
-    uv_mutex_unlock(&nsfw->mInterfaceLock);
+    uint32_t timeout = settleTimeout(idleSince);
+    if (readyForEvents() && !mQuiescence->empty()) {
+      uint64_t due = mQuiescence->nextRelease() * 1000000;
+      now = uv_hrtime();
+      uint32_t untilDue = due > now ? (uint32_t)((due - now + 999999) / 1000000) : 1;
+      timeout = timeout == 0 ? untilDue : std::min(timeout, untilDue);
+    }
 
-    sleep_for_ms(nsfw->mDebounceMS);
+    if (!took && mInterface->getSpilledEventCount() > 0) {
+      // spilled events wait for held events to make room, and only releasing those makes it
+      mInterface->pause(timeout != 0 ? timeout : UINT32_MAX);
+    } else {
+      // new events, JS becoming ready and the next path coming due all end the wait
+      mInterface->waitForEvents(timeout);
+    }
+  }
+
+  std::vector<Event *> *held = new std::vector<Event *>;
+  mQuiescence->releaseAll(*held);
+  mInterface->setHeldEvents(0, 0);
+  if (held->empty()) {
+    delete held;
+  } else {
+    handOver(held);
   }
 }
 
@@ -146,11 +719,62 @@ NAN_MODULE_INIT(NSFW::Init) {
   tpl->SetClassName(New<v8::String>("NSFW").ToLocalChecked());
   tpl->InstanceTemplate()->SetInternalFieldCount(1);
 
+  SetPrototypeMethod(tpl, "getStats", GetStats);
+  SetPrototypeMethod(tpl, "requestEvents", RequestEvents);
   SetPrototypeMethod(tpl, "start", Start);
   SetPrototypeMethod(tpl, "stop", Stop);
 
   constructor.Reset(tpl->GetFunction());
   Set(target, New<v8::String>("NSFW").ToLocalChecked(), tpl->GetFunction());
+
+  v8::Local<v8::String> action = internalize("action");
+  v8::Local<v8::String> directory = internalize("directory");
+  v8::Local<v8::String> file = internalize("file");
+  v8::Local<v8::String> oldFile = internalize("oldFile");
+  v8::Local<v8::String> newFile = internalize("newFile");
+  eventShapes.action.Reset(action);
+  eventShapes.directory.Reset(directory);
+  eventShapes.file.Reset(file);
+  eventShapes.oldFile.Reset(oldFile);
+  eventShapes.newFile.Reset(newFile);
+
+  // the placeholders are overwritten in every clone, their order is what fixes the hidden class
+  v8::Local<v8::String> placeholder = New<v8::String>("").ToLocalChecked();
+  v8::Local<v8::Object> change = New<v8::Object>();
+  change->Set(action, New<v8::Number>(CREATED));
+  change->Set(directory, placeholder);
+  change->Set(file, placeholder);
+  eventShapes.change.Reset(change);
+
+  // only events a coalescing watcher merged carry a count, so everyone else keeps the usual shape
+  v8::Local<v8::String> count = internalize("count");
+  eventShapes.count.Reset(count);
+  v8::Local<v8::Object> coalesced = New<v8::Object>();
+  coalesced->Set(action, New<v8::Number>(MODIFIED));
+  coalesced->Set(directory, placeholder);
+  coalesced->Set(file, placeholder);
+  coalesced->Set(count, New<v8::Number>(1));
+  eventShapes.coalesced.Reset(coalesced);
+
+  v8::Local<v8::Object> overflow = New<v8::Object>();
+  overflow->Set(action, New<v8::Number>(OVERFLOWED));
+  overflow->Set(directory, placeholder);
+  eventShapes.overflow.Reset(overflow);
+
+  v8::Local<v8::Object> rename = New<v8::Object>();
+  rename->Set(action, New<v8::Number>(RENAMED));
+  rename->Set(directory, placeholder);
+  rename->Set(oldFile, placeholder);
+  rename->Set(newFile, placeholder);
+  eventShapes.rename.Reset(rename);
+
+  v8::Local<v8::String> events = internalize("events");
+  eventShapes.events.Reset(events);
+
+  v8::Local<v8::Object> group = New<v8::Object>();
+  group->Set(directory, placeholder);
+  group->Set(events, New<v8::Array>());
+  eventShapes.group.Reset(group);
 }
 
 NAN_METHOD(NSFW::JSNew) {
@@ -172,18 +796,229 @@ NAN_METHOD(NSFW::JSNew) {
   if (info.Length() < 4 || !info[3]->IsFunction()) {
     return ThrowError("Fourth argument of constructor must be a callback.");
   }
+  if (info.Length() >= 5 && !info[4]->IsUndefined() && !info[4]->IsObject()) {
+    return ThrowError("Fifth argument of constructor must be an options object.");
+  }
 
   uint32_t debounceMS = info[0]->Uint32Value();
-  v8::String::Utf8Value utf8Value(info[1]->ToString());
-  std::string path = std::string(*utf8Value);
+  uint32_t debounceMinMS = debounceMS, debounceMaxMS = debounceMS;
+  DebounceMode debounceMode = DEBOUNCE_TRAILING;
+  QueueCapacity queueCapacity = { 0, 0, COLLAPSE_TO_OVERFLOW };
+  WatchOptions watchOptions = { false, ALL_ACTIONS };
+  CallbackLimits callbackLimits = { 0, 0, 0 };
+  BatchFormat batchFormat = BATCH_OBJECTS;
+  bool coalesce = false, netEffect = false, pull = false;
+  uint32_t quietMS = 0, settleMS = 0;
+  v8::Local<v8::Function> settledFunction;
+  std::vector<std::string> atomicSavePatterns;
+  if (info.Length() >= 5 && info[4]->IsObject()) {
+    v8::Local<v8::Object> options = info[4]->ToObject();
+
+    if (!getUint32Option(options, "maxCallbackEvents", callbackLimits.events)) {
+      return ThrowError("Option maxCallbackEvents must be a non-negative integer.");
+    }
+    if (!getUint32Option(options, "maxCallbackBytes", callbackLimits.bytes)) {
+      return ThrowError("Option maxCallbackBytes must be a non-negative integer.");
+    }
+    if (!getUint32Option(options, "maxCallbackMS", callbackLimits.ms)) {
+      return ThrowError("Option maxCallbackMS must be a non-negative integer.");
+    }
+
+    if (!getUint32Option(options, "quietMS", quietMS)) {
+      return ThrowError("Option quietMS must be a non-negative integer.");
+    }
+    if (!getUint32Option(options, "settleMS", settleMS)) {
+      return ThrowError("Option settleMS must be a non-negative integer.");
+    }
+    v8::Local<v8::Value> settledCallbackValue = getOption(options, "settledCallback");
+    if ((settleMS != 0) != settledCallbackValue->IsFunction()) {
+      return ThrowError("Options settleMS and settledCallback must be given together.");
+    } else if (settleMS != 0) {
+      settledFunction = settledCallbackValue.As<v8::Function>();
+    }
+
+    bool binary = getOption(options, "binary")->IsTrue();
+    bool grouped = getOption(options, "grouped")->IsTrue();
+    if (binary && grouped) {
+      return ThrowError("Options binary and grouped cannot be used together.");
+    }
+    batchFormat = binary ? BATCH_BINARY : grouped ? BATCH_GROUPED : BATCH_OBJECTS;
+
+    v8::Local<v8::Value> atomicSaveValue = getOption(options, "atomicSave");
+    if (!atomicSaveValue->IsUndefined()) {
+      if (!atomicSaveValue->IsArray()) {
+        return ThrowError("Option atomicSave must be an array of temp name patterns.");
+      }
+      v8::Local<v8::Array> patterns = atomicSaveValue.As<v8::Array>();
+      for (uint32_t i = 0; i < patterns->Length(); ++i) {
+        v8::Local<v8::Value> pattern = patterns->Get(i);
+        if (!pattern->IsString()) {
+          return ThrowError("Option atomicSave must be an array of temp name patterns.");
+        }
+        atomicSavePatterns.push_back(toUtf8(pattern));
+      }
+    }
+
+    watchOptions.closeWrite = getOption(options, "closeWrite")->IsTrue();
+    v8::Local<v8::Value> actionsValue = getOption(options, "actions");
+    if (!actionsValue->IsUndefined()) {
+      if (!actionsValue->IsArray()) {
+        return ThrowError("Option actions must be an array of actions.");
+      }
+      v8::Local<v8::Array> actions = actionsValue.As<v8::Array>();
+      watchOptions.actions = 0;
+      for (uint32_t i = 0; i < actions->Length(); ++i) {
+        v8::Local<v8::Value> action = actions->Get(i);
+        if (!action->IsUint32() || action->Uint32Value() > OVERFLOWED) {
+          return ThrowError("Option actions must be an array of actions.");
+        }
+        watchOptions.actions |= 1 << action->Uint32Value();
+      }
+    }
+    coalesce = getOption(options, "coalesce")->IsTrue();
+    netEffect = getOption(options, "netEffect")->IsTrue();
+    pull = getOption(options, "pull")->IsTrue();
+
+    v8::Local<v8::Value> debounceMinMSValue = getOption(options, "debounceMinMS");
+    v8::Local<v8::Value> debounceMaxMSValue = getOption(options, "debounceMaxMS");
+    if (!debounceMinMSValue->IsUndefined() || !debounceMaxMSValue->IsUndefined()) {
+      if (
+        !debounceMinMSValue->IsUint32() ||
+        !debounceMaxMSValue->IsUint32() ||
+        debounceMinMSValue->Uint32Value() < 1 ||
+        debounceMinMSValue->Uint32Value() > debounceMaxMSValue->Uint32Value()
+      ) {
+        return ThrowError("Options debounceMinMS and debounceMaxMS must be positive integers with min <= max.");
+      }
+      debounceMinMS = debounceMinMSValue->Uint32Value();
+      debounceMaxMS = debounceMaxMSValue->Uint32Value();
+      debounceMS = std::min(std::max(debounceMS, debounceMinMS), debounceMaxMS);
+    }
+
+    v8::Local<v8::Value> debounceModeValue = getOption(options, "debounceMode");
+    if (!debounceModeValue->IsUndefined()) {
+      std::string debounceModeName = toUtf8(debounceModeValue);
+      if (debounceModeName == "trailing") {
+        debounceMode = DEBOUNCE_TRAILING;
+      } else if (debounceModeName == "leading") {
+        debounceMode = DEBOUNCE_LEADING;
+      } else if (debounceModeName == "both") {
+        debounceMode = DEBOUNCE_BOTH;
+      } else {
+        return ThrowError("Option debounceMode must be 'leading', 'trailing' or 'both'.");
+      }
+    }
+
+    if (!getUint32Option(options, "maxQueueEvents", queueCapacity.events)) {
+      return ThrowError("Option maxQueueEvents must be a non-negative integer.");
+    }
+    if (!getUint32Option(options, "maxQueueBytes", queueCapacity.bytes)) {
+      return ThrowError("Option maxQueueBytes must be a non-negative integer.");
+    }
+
+    v8::Local<v8::Value> overflowPolicyValue = getOption(options, "overflowPolicy");
+    if (!overflowPolicyValue->IsUndefined()) {
+      std::string overflowPolicyName = toUtf8(overflowPolicyValue);
+      if (overflowPolicyName == "drop-oldest") {
+        queueCapacity.policy = DROP_OLDEST;
+      } else if (overflowPolicyName == "drop-newest") {
+        queueCapacity.policy = DROP_NEWEST;
+      } else if (overflowPolicyName == "collapse-to-overflow") {
+        queueCapacity.policy = COLLAPSE_TO_OVERFLOW;
+      } else if (overflowPolicyName == "spill") {
+        queueCapacity.policy = SPILL;
+      } else {
+        return ThrowError(
+          "Option overflowPolicy must be 'drop-oldest', 'drop-newest', 'collapse-to-overflow' or 'spill'."
+        );
+      }
+    }
+  }
+
+  std::string path = toUtf8(info[1]);
   Callback *eventCallback = new Callback(info[2].As<v8::Function>());
   Callback *errorCallback = new Callback(info[3].As<v8::Function>());
-
-  NSFW *nsfw = new NSFW(debounceMS, path, eventCallback, errorCallback);
+  Callback *settledCallback = settleMS != 0 ? new Callback(settledFunction) : NULL;
+
+  NSFW *nsfw = new NSFW(
+    debounceMS,
+    debounceMinMS,
+    debounceMaxMS,
+    debounceMode,
+    queueCapacity,
+    watchOptions,
+    callbackLimits,
+    quietMS,
+    settleMS,
+    batchFormat,
+    atomicSavePatterns,
+    coalesce,
+    netEffect,
+    pull,
+    path,
+    eventCallback,
+    errorCallback,
+    settledCallback
+  );
   nsfw->Wrap(info.This());
   info.GetReturnValue().Set(info.This());
 }
 
+NAN_METHOD(NSFW::GetStats) {
+  Nan::HandleScope scope;
+
+  NSFW *nsfw = ObjectWrap::Unwrap<NSFW>(info.This());
+  v8::Local<v8::Object> stats = New<v8::Object>();
+
+  stats->Set(
+    New<v8::String>("debounceMS").ToLocalChecked(),
+    New<v8::Number>(OPA_load_int(&nsfw->mEffectiveDebounceMS))
+  );
+  stats->Set(New<v8::String>("maxQueueEvents").ToLocalChecked(), New<v8::Number>(nsfw->mQueueCapacity.events));
+  stats->Set(New<v8::String>("maxQueueBytes").ToLocalChecked(), New<v8::Number>(nsfw->mQueueCapacity.bytes));
+
+  int queuedEvents = 0, coalescedEvents = 0, droppedEvents = 0, spilledEvents = 0;
+  uv_mutex_lock(&nsfw->mInterfaceLock);
+  if (nsfw->mInterface != NULL) {
+    queuedEvents = nsfw->mInterface->getQueuedEventCount();
+    coalescedEvents = nsfw->mInterface->getCoalescedEventCount();
+    droppedEvents = nsfw->mInterface->getDroppedEventCount();
+    spilledEvents = nsfw->mInterface->getSpilledEventCount();
+  }
+  uv_mutex_unlock(&nsfw->mInterfaceLock);
+
+  stats->Set(New<v8::String>("queuedEvents").ToLocalChecked(), New<v8::Number>(queuedEvents));
+  stats->Set(New<v8::String>("droppedEvents").ToLocalChecked(), New<v8::Number>(droppedEvents));
+  stats->Set(New<v8::String>("spilledEvents").ToLocalChecked(), New<v8::Number>(spilledEvents));
+  stats->Set(New<v8::String>("coalescedEvents").ToLocalChecked(), New<v8::Number>(coalescedEvents));
+  stats->Set(New<v8::String>("eventAllocations").ToLocalChecked(), New<v8::Number>(Pool::heapAllocations()));
+
+  info.GetReturnValue().Set(stats);
+}
+
+NAN_METHOD(NSFW::RequestEvents) {
+  Nan::HandleScope scope;
+
+  NSFW *nsfw = ObjectWrap::Unwrap<NSFW>(info.This());
+  if (!nsfw->mPull) {
+    return ThrowError("This NSFW delivers events to its callback, it was not created to pull them.");
+  }
+
+  // the rest of a chunked batch answers this pull, otherwise the poll thread has to hand over a new one
+  ++nsfw->mPulls;
+  if (nsfw->mPartialBaton == NULL) {
+    OPA_incr_int(&nsfw->mDemand);
+
+    uv_mutex_lock(&nsfw->mInterfaceLock);
+    if (nsfw->mInterface != NULL) {
+      nsfw->mInterface->wake();
+    }
+    uv_mutex_unlock(&nsfw->mInterfaceLock);
+  }
+
+  nsfw->drainEventBatons(false);
+}
+
 NAN_METHOD(NSFW::Start) {
   Nan::HandleScope scope;
 
@@ -219,26 +1054,37 @@ NSFW::StartWorker::StartWorker(NSFW *nsfw, Callback *callback):
   AsyncWorker(callback), mNSFW(nsfw) {
     uv_async_init(uv_default_loop(), &nsfw->mErrorCallbackAsync, &NSFW::fireErrorCallback);
     uv_async_init(uv_default_loop(), &nsfw->mEventCallbackAsync, &NSFW::fireEventCallback);
+    nsfw->mEventCallbackAsync.data = (void *)nsfw;
   }
 
 void NSFW::StartWorker::Execute() {
+  // mInterfaceLock only guards publishing the interface, the JS thread takes it for stats and wakes and must never
+  // wait behind the tree scan in the NativeInterface constructor
   uv_mutex_lock(&mNSFW->mInterfaceLock);
-
-  if (mNSFW->mInterface != NULL) {
-    uv_mutex_unlock(&mNSFW->mInterfaceLock);
+  bool running = mNSFW->mInterface != NULL;
+  uv_mutex_unlock(&mNSFW->mInterfaceLock);
+  if (running) {
     return;
   }
 
-  mNSFW->mInterface = new NativeInterface(mNSFW->mPath);
-  if (mNSFW->mInterface->isWatching()) {
-    mNSFW->mRunning = true;
-    uv_thread_create(&mNSFW->mPollThread, NSFW::pollForEvents, mNSFW);
-  } else {
-    delete mNSFW->mInterface;
-    mNSFW->mInterface = NULL;
+  NativeInterface *nativeInterface = new NativeInterface(
+    mNSFW->mPath,
+    mNSFW->mQueueCapacity,
+    mNSFW->mCoalesce,
+    mNSFW->mWatchOptions
+  );
+  if (!nativeInterface->isWatching()) {
+    delete nativeInterface;
+    return;
   }
 
+  uv_mutex_lock(&mNSFW->mInterfaceLock);
+  mNSFW->mInterface = nativeInterface;
   uv_mutex_unlock(&mNSFW->mInterfaceLock);
+
+  OPA_store_int(&mNSFW->mEffectiveDebounceMS, mNSFW->mDebounceMS);
+  mNSFW->mRunning = true;
+  uv_thread_create(&mNSFW->mPollThread, NSFW::pollForEvents, mNSFW);
 }
 
 void NSFW::StartWorker::HandleOKCallback() {
@@ -291,20 +1137,24 @@ NSFW::StopWorker::StopWorker(NSFW *nsfw, Callback *callback):
 
 void NSFW::StopWorker::Execute() {
   uv_mutex_lock(&mNSFW->mInterfaceLock);
-
-  if (mNSFW->mInterface == NULL) {
-    uv_mutex_unlock(&mNSFW->mInterfaceLock);
+  NativeInterface *nativeInterface = mNSFW->mInterface;
+  if (nativeInterface != NULL) {
+    mNSFW->mRunning = false;
+    nativeInterface->interrupt();
+  }
+  uv_mutex_unlock(&mNSFW->mInterfaceLock);
+  if (nativeInterface == NULL) {
     return;
   }
 
-  mNSFW->mRunning = false;
-
+  // join without the lock held, so stats and wakes from the JS thread go through while the poll thread winds down
   uv_thread_join(&mNSFW->mPollThread);
 
-  delete mNSFW->mInterface;
+  uv_mutex_lock(&mNSFW->mInterfaceLock);
   mNSFW->mInterface = NULL;
-
   uv_mutex_unlock(&mNSFW->mInterfaceLock);
+
+  delete nativeInterface;
 }
 
 void NSFW::StopWorker::HandleOKCallback() {
@@ -315,6 +1165,13 @@ void NSFW::StopWorker::HandleOKCallback() {
     mNSFW->mPersistentHandle.Reset(obj);
   }
 
+  // the poll thread has exited, hand over whatever it queued before the async handle goes away. A pulling watcher
+  // keeps only what was asked for, and the JS side answers its outstanding pulls once we call back.
+  mNSFW->drainEventBatons(true);
+  mNSFW->discardEventBatons();
+  OPA_store_int(&mNSFW->mDemand, 0);
+  mNSFW->mPulls = 0;
+
   uv_close(reinterpret_cast<uv_handle_t*>(&mNSFW->mErrorCallbackAsync), nullptr);
   uv_close(reinterpret_cast<uv_handle_t*>(&mNSFW->mEventCallbackAsync), nullptr);
 
@@ -11,14 +11,23 @@
 #include "../includes/linux/InotifyService.h"
 #endif
 
-NativeInterface::NativeInterface(std::string path) {
-  mNativeInterface = new SERVICE(mQueue, path);
+NativeInterface::NativeInterface(std::string path, QueueCapacity capacity, bool coalesce, WatchOptions options):
+  mQueue(path, capacity, coalesce, options.actions) {
+  mNativeInterface = new SERVICE(mQueue, path, options);
 }
 
 NativeInterface::~NativeInterface() {
   delete (SERVICE *)mNativeInterface;
 }
 
+int NativeInterface::getCoalescedEventCount() {
+  return mQueue.coalesced();
+}
+
+int NativeInterface::getDroppedEventCount() {
+  return mQueue.dropped();
+}
+
 std::string NativeInterface::getError() {
   return ((SERVICE *)mNativeInterface)->getError();
 }
@@ -28,16 +37,27 @@ std::vector<Event *> *NativeInterface::getEvents() {
     return NULL;
   }
 
-  int count = mQueue.count();
+  // spilled events stay on disk until a later batch has room for them
+  mQueue.refill();
   std::vector<Event *> *events = new std::vector<Event *>;
-  events->reserve(count);
-  for (int i = 0; i < count; ++i) {
-    events->push_back(mQueue.dequeue());
+  mQueue.dequeueAll(*events);
+
+  if (events->empty()) {
+    delete events;
+    return NULL;
   }
 
   return events;
 }
 
+int NativeInterface::getQueuedEventCount() {
+  return mQueue.count();
+}
+
+int NativeInterface::getSpilledEventCount() {
+  return mQueue.spilled();
+}
+
 bool NativeInterface::hasErrored() {
   return ((SERVICE *)mNativeInterface)->hasErrored();
 }
@@ -45,3 +65,27 @@ bool NativeInterface::hasErrored() {
 bool NativeInterface::isWatching() {
   return ((SERVICE *)mNativeInterface)->isWatching();
 }
+
+void NativeInterface::interrupt() {
+  mQueue.interrupt();
+}
+
+void NativeInterface::pause(uint32_t milliseconds) {
+  mQueue.pause(milliseconds);
+}
+
+void NativeInterface::setHeldEvents(uint32_t events, uint32_t bytes) {
+  mQueue.setHeld(events, bytes);
+}
+
+void NativeInterface::sleep(uint32_t milliseconds) {
+  mQueue.sleep(milliseconds);
+}
+
+bool NativeInterface::waitForEvents(uint32_t milliseconds) {
+  return mQueue.wait(milliseconds);
+}
+
+void NativeInterface::wake() {
+  mQueue.wake();
+}
@@ -0,0 +1,144 @@
+#include "../includes/NetEffect.h"
+#include <algorithm>
+#include <cstdint>
+
+#pragma unmanaged
+void NetEffect::reduce(std::vector<Event *> &events) {
+  mPaths.clear();
+
+  for (int i = 0; i < (int)events.size(); ++i) {
+    Event *event = events[i];
+    if (event->type == OVERFLOWED) {
+      // nothing before an overflow can be built on, consumers rescan anyway
+      mPaths.clear();
+      continue;
+    }
+
+    std::string name = event->keyA();
+
+    if (event->type == CREATED) {
+      Path &path = mPaths[name];
+      path = Path();
+      path.created = i;
+    } else if (event->type == MODIFIED) {
+      Path &path = mPaths[name];
+      if (path.created >= 0) {
+        remove(events, i);
+      } else if (path.modified >= 0) {
+        Event *modified = events[path.modified];
+        modified->count = (uint16_t)std::min(modified->count + event->count, UINT16_MAX);
+        remove(events, i);
+      } else {
+        path.modified = i;
+      }
+    } else if (event->type == DELETED) {
+      Path &path = mPaths[name];
+      if (path.created >= 0) {
+        remove(events, path.created);
+        remove(events, i);
+        mPaths.erase(name);
+        continue;
+      }
+
+      if (path.modified >= 0) {
+        remove(events, path.modified);
+      }
+
+      if (path.renamed >= 0) {
+        // the file is gone under the name it had before the batch, unless that name has been reused since
+        Event *renamed = events[path.renamed];
+        std::string origin = renamed->keyA();
+        if (idle(origin)) {
+          replace(events, i, Event::create(
+            DELETED,
+            renamed->directory,
+            StringView(renamed->fileA(), renamed->fileALength)
+          ));
+          remove(events, path.renamed);
+          if (path.originModified >= 0) {
+            remove(events, path.originModified);
+          }
+          mPaths.erase(name);
+          mPaths[origin].other = i;
+          continue;
+        }
+      }
+
+      path = Path();
+      path.other = i;
+    } else if (event->type == RENAMED) {
+      std::string target = event->keyB();
+      if (target == name) {
+        continue;
+      }
+
+      Path source = mPaths[name];
+      mPaths.erase(name);
+
+      // a rename over a path with a history of its own replaces that path, leave both alone rather than guess
+      Path next;
+      if (!idle(target)) {
+        next.other = i;
+      } else if (source.created >= 0) {
+        replace(events, i, Event::create(
+          CREATED,
+          event->directory,
+          StringView(event->fileB(), event->fileBLength)
+        ));
+        remove(events, source.created);
+        next.created = i;
+      } else if (source.renamed >= 0 && source.modified < 0) {
+        Event *earlier = events[source.renamed];
+        std::string origin = earlier->keyA();
+        if (!idle(origin)) {
+          next.renamed = i;
+        } else if (origin == target) {
+          // renamed back to where it started, keeping whatever happened to it under its own name
+          remove(events, i);
+          remove(events, source.renamed);
+          next.modified = source.originModified;
+        } else {
+          replace(events, i, Event::create(
+            RENAMED,
+            event->directory,
+            StringView(earlier->fileA(), earlier->fileALength),
+            StringView(event->fileB(), event->fileBLength)
+          ));
+          remove(events, source.renamed);
+          next.renamed = i;
+          next.originModified = source.originModified;
+        }
+      } else {
+        next.renamed = i;
+        if (source.renamed < 0) {
+          next.originModified = source.modified;
+        }
+      }
+      mPaths[target] = next;
+    }
+  }
+
+  events.erase(std::remove(events.begin(), events.end(), (Event *)NULL), events.end());
+  mPaths.clear();
+}
+
+bool NetEffect::idle(const std::string &path) {
+  auto found = mPaths.find(path);
+  return found == mPaths.end() || (
+    found->second.created < 0 &&
+    found->second.modified < 0 &&
+    found->second.originModified < 0 &&
+    found->second.other < 0 &&
+    found->second.renamed < 0
+  );
+}
+
+void NetEffect::remove(std::vector<Event *> &events, int index) {
+  delete events[index];
+  events[index] = NULL;
+}
+
+void NetEffect::replace(std::vector<Event *> &events, int index, Event *event) {
+  delete events[index];
+  events[index] = event;
+}
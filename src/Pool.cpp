@@ -0,0 +1,108 @@
+#include "../includes/Pool.h"
+#include <new>
+
+#pragma unmanaged
+OPA_int_t Pool::sHeapAllocations = { 0 };
+
+Pool::Pool(size_t blockSize, int maxFreeBlocks):
+  mBlockSize(blockSize < sizeof(Block) ? sizeof(Block) : blockSize),
+  mMaxFreeBlocks(maxFreeBlocks) {
+  OPA_Queue_init(&mFreeBlocks);
+  OPA_store_int(&mNumFreeBlocks, 0);
+  uv_mutex_init(&mAllocateLock);
+}
+
+Pool::~Pool() {
+  while (!OPA_Queue_is_empty(&mFreeBlocks)) {
+    Block *block;
+    OPA_Queue_dequeue(&mFreeBlocks, block, Block, header);
+    ::operator delete((void *)block);
+  }
+  uv_mutex_destroy(&mAllocateLock);
+}
+
+void *Pool::allocate() {
+  Block *block = NULL;
+
+  uv_mutex_lock(&mAllocateLock);
+  if (!OPA_Queue_is_empty(&mFreeBlocks)) {
+    OPA_Queue_dequeue(&mFreeBlocks, block, Block, header);
+    OPA_decr_int(&mNumFreeBlocks);
+  }
+  uv_mutex_unlock(&mAllocateLock);
+
+  if (block == NULL) {
+    OPA_incr_int(&sHeapAllocations);
+    return ::operator new(mBlockSize);
+  }
+  return (void *)block;
+}
+
+int Pool::heapAllocations() {
+  return OPA_load_int(&sHeapAllocations);
+}
+
+void Pool::release(void *memory) {
+  if (memory == NULL) {
+    return;
+  }
+
+  // past the cap a burst gives its memory back instead of keeping it for the next one
+  if (OPA_fetch_and_incr_int(&mNumFreeBlocks) >= mMaxFreeBlocks) {
+    OPA_decr_int(&mNumFreeBlocks);
+    ::operator delete(memory);
+    return;
+  }
+
+  Block *block = (Block *)memory;
+  OPA_Queue_header_init(&block->header);
+  OPA_Queue_enqueue(&mFreeBlocks, block, Block, header);
+}
+
+// Classes are block sizes including the prefix, most events fit one of the first two
+const size_t SizedPool::SIZE_CLASSES[SizedPool::NUM_SIZE_CLASSES] = { 48, 64, 96, 128, 192, 256, 384, 512 };
+
+SizedPool::SizedPool(int maxFreeBlocks) {
+  for (int i = 0; i < NUM_SIZE_CLASSES; ++i) {
+    mPools[i] = new Pool(SIZE_CLASSES[i], maxFreeBlocks);
+  }
+}
+
+SizedPool::~SizedPool() {
+  for (int i = 0; i < NUM_SIZE_CLASSES; ++i) {
+    delete mPools[i];
+  }
+}
+
+void *SizedPool::allocate(size_t size) {
+  size_t blockSize = sizeof(BlockPrefix) + size;
+
+  BlockPrefix *prefix = NULL;
+  for (int i = 0; i < NUM_SIZE_CLASSES && prefix == NULL; ++i) {
+    if (blockSize <= SIZE_CLASSES[i]) {
+      prefix = (BlockPrefix *)mPools[i]->allocate();
+      prefix->pool = mPools[i];
+    }
+  }
+
+  if (prefix == NULL) {
+    OPA_incr_int(&Pool::sHeapAllocations);
+    prefix = (BlockPrefix *)::operator new(blockSize);
+    prefix->pool = NULL;
+  }
+
+  return (void *)(prefix + 1);
+}
+
+void SizedPool::release(void *block) {
+  if (block == NULL) {
+    return;
+  }
+
+  BlockPrefix *prefix = (BlockPrefix *)block - 1;
+  if (prefix->pool != NULL) {
+    prefix->pool->release(prefix);
+  } else {
+    ::operator delete(prefix);
+  }
+}
@@ -1,65 +1,591 @@
 #include "../includes/Queue.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// Enough free blocks to absorb a burst without going back to the heap, without holding on to a burst's worth
+#define MAX_FREE_EVENTS 16384
+
+// A spilled event is written as its type, the lengths of its directory and names, and its arrival time in two halves,
+// followed by the characters
+#define SPILL_HEADER_FIELDS 6
 
 #pragma unmanaged
-EventQueue::EventQueue() {
-  OPA_Queue_init(&mQueue);
+SizedPool Event::sPool(MAX_FREE_EVENTS);
+
+// The inotify and FSEvents readers are stopped with pthread_cancel, and the spill file's I/O is full of cancellation
+// points. A reader cancelled partway through a spill would leave mSpillLock held for good, so cancellation waits until
+// the lock is released.
+static int lockSpill(uv_mutex_t *lock) {
+  int cancelState = 0;
+#ifndef _WIN32
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancelState);
+#endif
+  uv_mutex_lock(lock);
+  return cancelState;
+}
+
+static void unlockSpill(uv_mutex_t *lock, int cancelState) {
+  uv_mutex_unlock(lock);
+#ifndef _WIN32
+  pthread_setcancelstate(cancelState, NULL);
+#endif
+}
+
+// A spill file can outgrow a long, which is 32 bits on Windows and on 32-bit builds
+static int seekSpill(FILE *file, int64_t offset) {
+#ifdef _WIN32
+  return _fseeki64(file, offset, SEEK_SET);
+#else
+  return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+}
+
+static int64_t tellSpill(FILE *file) {
+#ifdef _WIN32
+  return _ftelli64(file);
+#else
+  return (int64_t)ftello(file);
+#endif
+}
+
+Event::Event(EventType type, const PathHandle &directory, StringView fileA, StringView fileB):
+  directory(directory),
+  arrived(0),
+  fileALength((uint16_t)fileA.length),
+  fileBLength((uint16_t)fileB.length),
+  count(1),
+  type((uint8_t)type) {
+  char *names = reinterpret_cast<char *>(this + 1);
+  memcpy(names, fileA.data, fileALength);
+  names[fileALength] = '\0';
+  memcpy(names + fileALength + 1, fileB.data, fileBLength);
+  names[fileALength + 1 + fileBLength] = '\0';
+}
+
+Event *Event::create(EventType type, const PathHandle &directory, StringView fileA, StringView fileB) {
+  void *memory = sPool.allocate(sizeof(Event) + fileA.length + fileB.length + 2);
+  return ::new (memory) Event(type, directory, fileA, fileB);
+}
+
+void Event::operator delete(void *event) {
+  SizedPool::release(event);
+}
+
+EventQueue::EventQueue(std::string root, QueueCapacity capacity, bool coalesce, uint32_t actions):
+  mActions(actions | (1 << OVERFLOWED)),
+  mCapacity(capacity),
+  mCoalesce(coalesce),
+  mInterrupted(false),
+  mRoot(std::make_shared<const std::string>(root)),
+  mSpillFile(NULL),
+  mSpillReadOffset(0),
+  mSpillWriteOffset(0),
+  mWoken(false) {
+  OPA_store_int(&mNumBytes, 0);
+  OPA_store_int(&mNumCoalesced, 0);
+  OPA_store_int(&mNumDropped, 0);
   OPA_store_int(&mNumEvents, 0);
+  OPA_store_int(&mNumHeld, 0);
+  OPA_store_int(&mNumHeldBytes, 0);
+  OPA_store_int(&mNumSpilled, 0);
+  OPA_store_int(&mWaiting, 0);
+  uv_mutex_init(&mCoalesceLock);
+  uv_mutex_init(&mDequeueLock);
+  uv_mutex_init(&mSignalLock);
+  uv_mutex_init(&mSpillLock);
+  uv_cond_init(&mSignal);
 }
 
 EventQueue::~EventQueue() {
-  while(!OPA_Queue_is_empty(&mQueue)) {
-    EventNode *node;
-
-    OPA_Queue_dequeue(&mQueue, node, EventNode, header);
+  Event *event;
+  while(mQueue.pop(event)) {
+    delete event;
+  }
 
-    delete node->event;
-    delete node;
+  if (mSpillFile != NULL) {
+    fclose(mSpillFile);
   }
+
+  uv_cond_destroy(&mSignal);
+  uv_mutex_destroy(&mSpillLock);
+  uv_mutex_destroy(&mSignalLock);
+  uv_mutex_destroy(&mDequeueLock);
+  uv_mutex_destroy(&mCoalesceLock);
+}
+
+int EventQueue::bytes() {
+  return OPA_load_int(&mNumBytes);
 }
 
 void EventQueue::clear() {
-  while(!OPA_Queue_is_empty(&mQueue)) {
-    EventNode *node;
+  uv_mutex_lock(&mCoalesceLock);
+  int cancelState = lockSpill(&mSpillLock);
+  uv_mutex_lock(&mDequeueLock);
+
+  Event *event;
+  while((event = dequeueUnlocked()) != NULL) {
+    delete event;
+  }
 
-    OPA_decr_int(&mNumEvents);
-    OPA_Queue_dequeue(&mQueue, node, EventNode, header);
+  OPA_store_int(&mNumSpilled, 0);
+  mSpillReadOffset = mSpillWriteOffset = 0;
+  mLastSpilledDirectory.reset();
+
+  uv_mutex_unlock(&mDequeueLock);
+  unlockSpill(&mSpillLock, cancelState);
+  uv_mutex_unlock(&mCoalesceLock);
+}
+
+// Merges a MODIFIED event into the pending one for its path, if nothing else has happened to that path since. Any
+// other event for a path means the next MODIFIED has to be delivered after it, so the pending one is forgotten.
+// Called with mCoalesceLock held.
+bool EventQueue::coalesce(EventType type, const std::string &directory, StringView fileA, StringView fileB) {
+  if (type == MODIFIED) {
+    auto pending = mPendingModified.find(pathKey(directory, fileA));
+    if (pending == mPendingModified.end()) {
+      return false;
+    }
+    if (pending->second->count < UINT16_MAX) {
+      ++pending->second->count;
+    }
+    pending->second->arrived = uv_hrtime();
+    OPA_incr_int(&mNumCoalesced);
+    return true;
+  }
 
-    delete node->event;
-    delete node;
+  mPendingModified.erase(pathKey(directory, fileA));
+  if (type == RENAMED) {
+    mPendingModified.erase(pathKey(directory, fileB));
   }
+  return false;
+}
+
+std::string pathKey(const std::string &directory, StringView file) {
+  std::string key;
+  key.reserve(directory.size() + file.length + 1);
+  key.append(directory);
+  key.push_back('\0');
+  key.append(file.data, file.length);
+  return key;
+}
+
+int EventQueue::coalesced() {
+  return OPA_load_int(&mNumCoalesced);
 }
 
 int EventQueue::count() {
-  return OPA_load_int(&mNumEvents);
-  return 0;
+  return OPA_load_int(&mNumEvents) + OPA_load_int(&mNumSpilled);
 }
 
+// The ring allows a single consumer at a time. Only a bounded queue has a second one, the producer discarding events
+// to make room, so only a bounded queue pays for the lock. Likewise the only second producer, refill, shares
+// mSpillLock with the producer. A coalescing queue also locks out the producer while an event leaves, since the
+// producer may be about to merge into it.
 Event *EventQueue::dequeue() {
-  if (!OPA_Queue_is_empty(&mQueue)) {
-    EventNode *node;
+  bool bounded = mCapacity.events != 0 || mCapacity.bytes != 0;
+  if (mCoalesce) {
+    uv_mutex_lock(&mCoalesceLock);
+  }
+  if (bounded) {
+    uv_mutex_lock(&mDequeueLock);
+  }
 
-    OPA_decr_int(&mNumEvents);
-    OPA_Queue_dequeue(&mQueue, node, EventNode, header);
+  Event *event = dequeueUnlocked();
 
-    Event *event = node->event;
-    delete node;
+  if (bounded) {
+    uv_mutex_unlock(&mDequeueLock);
+  }
+  if (mCoalesce) {
+    uv_mutex_unlock(&mCoalesceLock);
+  }
+  return event;
+}
 
+// Takes the whole backlog in one pass over the ring and settles the counts for the batch at once, rather than paying
+// two atomic updates per event and contending with the producer on every one of them
+size_t EventQueue::dequeueAll(std::vector<Event *> &events) {
+  bool bounded = mCapacity.events != 0 || mCapacity.bytes != 0;
+  if (mCoalesce) {
+    uv_mutex_lock(&mCoalesceLock);
+  }
+  if (bounded) {
+    uv_mutex_lock(&mDequeueLock);
+  }
+
+  size_t start = events.size(), end = start;
+  size_t room = (size_t)std::max(OPA_load_int(&mNumEvents), 1);
+  for (;;) {
+    // the producer may publish more while we copy, so keep going until the ring comes up short
+    events.resize(end + room);
+    size_t popped = mQueue.pop(&events[end], room);
+    end += popped;
+    if (popped < room) {
+      break;
+    }
+  }
+  events.resize(end);
+
+  OPA_add_int(&mNumEvents, -(int)(end - start));
+  if (mCapacity.bytes != 0) {
+    int size = 0;
+    for (size_t i = start; i < end; ++i) {
+      size += eventSize(events[i]);
+    }
+    OPA_add_int(&mNumBytes, -size);
+  }
+
+  // everything that could be merged into has just left
+  mPendingModified.clear();
+
+  if (bounded) {
+    uv_mutex_unlock(&mDequeueLock);
+  }
+  if (mCoalesce) {
+    uv_mutex_unlock(&mCoalesceLock);
+  }
+  return end - start;
+}
+
+Event *EventQueue::dequeueUnlocked() {
+  Event *event;
+  if (!mQueue.pop(event)) {
+    return NULL;
+  }
+
+  OPA_decr_int(&mNumEvents);
+  if (mCapacity.bytes != 0) {
+    OPA_add_int(&mNumBytes, -eventSize(event));
+  }
+
+  if (mCoalesce && event->type == MODIFIED) {
+    StringView file(event->fileA(), event->fileALength);
+    auto pending = mPendingModified.find(pathKey(*event->directory, file));
+    if (pending != mPendingModified.end() && pending->second == event) {
+      mPendingModified.erase(pending);
+    }
+  }
+
+  return event;
+}
+
+int EventQueue::dropped() {
+  return OPA_load_int(&mNumDropped);
+}
+
+void EventQueue::enqueue(EventType type, const PathHandle &directory, StringView fileA, StringView fileB) {
+  if (!wanted(type)) {
+    return;
+  }
+
+  if (!mCoalesce) {
+    enqueueEvent(type, directory, fileA, fileB);
+    return;
+  }
+
+  // the lock keeps the consumer from taking a pending event while we merge into it or remember it
+  uv_mutex_lock(&mCoalesceLock);
+  if (!coalesce(type, *directory, fileA, fileB)) {
+    Event *event = enqueueEvent(type, directory, fileA, fileB);
+    if (event != NULL && type == MODIFIED) {
+      mPendingModified[pathKey(*directory, fileA)] = event;
+    }
+  }
+  uv_mutex_unlock(&mCoalesceLock);
+}
+
+// Returns the event if it went into memory, or NULL if it was spilled or dropped. The consumer may already have taken
+// the event unless mCoalesceLock is held.
+Event *EventQueue::enqueueEvent(EventType type, const PathHandle &directory, StringView fileA, StringView fileB) {
+  int size = eventSize(directory->size(), fileA.length, fileB.length);
+
+  if (mCapacity.policy == SPILL) {
+    Event *event = Event::create(type, directory, fileA, fileB);
+    event->arrived = uv_hrtime();
+
+    // once anything has been spilled, newer events must follow it to disk to stay behind it in order. If the disk
+    // fails us, keeping the event matters more than keeping its place.
+    int cancelState = lockSpill(&mSpillLock);
+    if ((OPA_load_int(&mNumSpilled) == 0 && hasRoomFor(size)) || !spill(event)) {
+      push(event);
+    } else {
+      event = NULL;
+    }
+    unlockSpill(&mSpillLock, cancelState);
     return event;
   }
-  return NULL;
+
+  if (!hasRoomFor(size)) {
+    if (mCapacity.policy == DROP_NEWEST) {
+      OPA_incr_int(&mNumDropped);
+      return NULL;
+    }
+
+    uv_mutex_lock(&mDequeueLock);
+
+    Event *discarded;
+    if (mCapacity.policy == DROP_OLDEST) {
+      while (!hasRoomFor(size) && (discarded = dequeueUnlocked()) != NULL) {
+        OPA_incr_int(&mNumDropped);
+        delete discarded;
+      }
+
+      // held events are out of our reach, so when they alone fill the limits the new event has to go instead
+      if (OPA_load_int(&mNumHeld) > 0 && !hasRoomFor(size)) {
+        uv_mutex_unlock(&mDequeueLock);
+        OPA_incr_int(&mNumDropped);
+        return NULL;
+      }
+    } else {
+      while ((discarded = dequeueUnlocked()) != NULL) {
+        if (discarded->type != OVERFLOWED) {
+          OPA_incr_int(&mNumDropped);
+        }
+        delete discarded;
+      }
+    }
+
+    uv_mutex_unlock(&mDequeueLock);
+
+    if (mCapacity.policy == COLLAPSE_TO_OVERFLOW) {
+      // the incoming event goes down with the rest, consumers rescan mRoot when they see the overflow
+      OPA_incr_int(&mNumDropped);
+      Event *overflow = Event::create(OVERFLOWED, mRoot, StringView());
+      overflow->arrived = uv_hrtime();
+      push(overflow);
+      return NULL;
+    }
+  }
+
+  Event *event = Event::create(type, directory, fileA, fileB);
+  event->arrived = uv_hrtime();
+  push(event);
+  return event;
 }
 
-void EventQueue::enqueue(EventType type, std::string directory, std::string fileA, std::string fileB) {
-  EventNode *node = new EventNode;
+// For backends that do not keep their own copy of each path around. Each backend enqueues from a single thread, so
+// the last path can be remembered without a lock, and a run of events in one directory shares it.
+void EventQueue::enqueue(EventType type, const std::string &directory, StringView fileA, StringView fileB) {
+  if (!wanted(type)) {
+    return;
+  }
+
+  if (!mLastDirectory || *mLastDirectory != directory) {
+    mLastDirectory = std::make_shared<const std::string>(directory);
+  }
+  enqueue(type, mLastDirectory, fileA, fileB);
+}
+
+int EventQueue::eventSize(size_t directoryLength, size_t fileALength, size_t fileBLength) {
+  return (int)(sizeof(Event) + directoryLength + fileALength + fileBLength + 2);
+}
 
-  OPA_Queue_header_init(&node->header);
+int EventQueue::eventSize(const Event *event) {
+  return eventSize(event->directory->size(), event->fileALength, event->fileBLength);
+}
 
-  node->event = new Event;
-  node->event->type = type;
-  node->event->directory = directory;
-  node->event->fileA = fileA;
-  node->event->fileB = fileB;
+bool EventQueue::hasRoomFor(int size) {
+  return (
+    mCapacity.events == 0 ||
+    (uint32_t)(OPA_load_int(&mNumEvents) + OPA_load_int(&mNumHeld)) < mCapacity.events
+  ) && (
+    mCapacity.bytes == 0 ||
+    (uint32_t)(bytes() + OPA_load_int(&mNumHeldBytes) + size) <= mCapacity.bytes
+  );
+}
 
-  OPA_Queue_enqueue(&mQueue, node, EventNode, header);
+void EventQueue::push(Event *event) {
+  if (mCapacity.bytes != 0) {
+    OPA_add_int(&mNumBytes, eventSize(event));
+  }
+  mQueue.push(event);
   OPA_incr_int(&mNumEvents);
+
+  signalWaiter();
+}
+
+Event *EventQueue::readSpilled() {
+  uint32_t header[SPILL_HEADER_FIELDS];
+  if (
+    seekSpill(mSpillFile, mSpillReadOffset) != 0 ||
+    fread(header, sizeof(uint32_t), SPILL_HEADER_FIELDS, mSpillFile) != SPILL_HEADER_FIELDS
+  ) {
+    return NULL;
+  }
+
+  std::string directory, fileA, fileB;
+  std::string *fields[3] = { &directory, &fileA, &fileB };
+  for (int i = 0; i < 3; ++i) {
+    fields[i]->resize(header[i + 1]);
+    if (header[i + 1] > 0 && fread(&(*fields[i])[0], 1, header[i + 1], mSpillFile) != header[i + 1]) {
+      return NULL;
+    }
+  }
+
+  // spilled events lose their shared paths, runs of events in one directory get to share again
+  if (!mLastSpilledDirectory || *mLastSpilledDirectory != directory) {
+    mLastSpilledDirectory = std::make_shared<const std::string>(directory);
+  }
+
+  mSpillReadOffset = tellSpill(mSpillFile);
+  Event *event = Event::create((EventType)header[0], mLastSpilledDirectory, fileA, fileB);
+  event->arrived = (uint64_t)header[4] | (uint64_t)header[5] << 32;
+  return event;
+}
+
+// Only the policy decides what refill does, so callers do not need to know whether the queue spills
+void EventQueue::refill() {
+  if (mCapacity.policy != SPILL || OPA_load_int(&mNumEvents) != 0 || OPA_load_int(&mNumSpilled) == 0) {
+    return;
+  }
+
+  int cancelState = lockSpill(&mSpillLock);
+
+  // events held by the consumer may still be taking up the room
+  Event *event;
+  while (OPA_load_int(&mNumSpilled) > 0 && hasRoomFor(0)) {
+    if ((event = readSpilled()) == NULL) {
+      // the spill file can no longer be read, the best we can do is report what it held as dropped
+      OPA_add_int(&mNumDropped, OPA_load_int(&mNumSpilled));
+      OPA_store_int(&mNumSpilled, 0);
+      break;
+    }
+
+    OPA_decr_int(&mNumSpilled);
+    push(event);
+  }
+
+  // reuse the file from the start once it has been read back in full
+  if (OPA_load_int(&mNumSpilled) == 0) {
+    mSpillReadOffset = mSpillWriteOffset = 0;
+    mLastSpilledDirectory.reset();
+  }
+
+  unlockSpill(&mSpillLock, cancelState);
+}
+
+void EventQueue::signalWaiter() {
+  // Callers increment a count first, which is a full barrier, so either we see the consumer waiting here or it sees
+  // the event
+  if (OPA_load_int(&mWaiting)) {
+    uv_mutex_lock(&mSignalLock);
+    uv_cond_signal(&mSignal);
+    uv_mutex_unlock(&mSignalLock);
+  }
+}
+
+bool EventQueue::spill(Event *event) {
+  if (mSpillFile == NULL && (mSpillFile = tmpfile()) == NULL) {
+    return false;
+  }
+
+  uint32_t header[SPILL_HEADER_FIELDS] = {
+    (uint32_t)event->type,
+    (uint32_t)event->directory->size(),
+    event->fileALength,
+    event->fileBLength,
+    (uint32_t)event->arrived,
+    (uint32_t)(event->arrived >> 32)
+  };
+
+  if (
+    seekSpill(mSpillFile, mSpillWriteOffset) != 0 ||
+    fwrite(header, sizeof(uint32_t), SPILL_HEADER_FIELDS, mSpillFile) != SPILL_HEADER_FIELDS ||
+    fwrite(event->directory->data(), 1, header[1], mSpillFile) != header[1] ||
+    fwrite(event->fileA(), 1, header[2], mSpillFile) != header[2] ||
+    fwrite(event->fileB(), 1, header[3], mSpillFile) != header[3]
+  ) {
+    return false;
+  }
+
+  mSpillWriteOffset = tellSpill(mSpillFile);
+  delete event;
+
+  OPA_incr_int(&mNumSpilled);
+  signalWaiter();
+  return true;
+}
+
+void EventQueue::setHeld(uint32_t events, uint32_t bytes) {
+  OPA_store_int(&mNumHeld, (int)events);
+  OPA_store_int(&mNumHeldBytes, (int)bytes);
+}
+
+int EventQueue::spilled() {
+  return OPA_load_int(&mNumSpilled);
+}
+
+void EventQueue::interrupt() {
+  uv_mutex_lock(&mSignalLock);
+  mInterrupted = true;
+  uv_cond_broadcast(&mSignal);
+  uv_mutex_unlock(&mSignalLock);
+}
+
+void EventQueue::pause(uint32_t milliseconds) {
+  uint64_t deadline = uv_hrtime() + (uint64_t)milliseconds * 1000000;
+
+  uv_mutex_lock(&mSignalLock);
+
+  uint64_t now;
+  while (!mWoken && !mInterrupted && (now = uv_hrtime()) < deadline) {
+    uv_cond_timedwait(&mSignal, &mSignalLock, deadline - now);
+  }
+
+  mWoken = false;
+
+  uv_mutex_unlock(&mSignalLock);
+}
+
+// A wake that comes in meanwhile stays pending for the next pause or wait, it is only the debounce window that carries
+// on regardless
+void EventQueue::sleep(uint32_t milliseconds) {
+  uint64_t deadline = uv_hrtime() + (uint64_t)milliseconds * 1000000;
+
+  uv_mutex_lock(&mSignalLock);
+
+  uint64_t now;
+  while (!mInterrupted && (now = uv_hrtime()) < deadline) {
+    uv_cond_timedwait(&mSignal, &mSignalLock, deadline - now);
+  }
+
+  uv_mutex_unlock(&mSignalLock);
+}
+
+bool EventQueue::wait(uint32_t milliseconds) {
+  uint64_t deadline = milliseconds == 0 ? 0 : uv_hrtime() + (uint64_t)milliseconds * 1000000;
+
+  uv_mutex_lock(&mSignalLock);
+
+  OPA_swap_int(&mWaiting, 1);
+  OPA_read_write_barrier();
+
+  uint64_t now;
+  while (count() == 0 && !mWoken && !mInterrupted) {
+    if (deadline == 0) {
+      uv_cond_wait(&mSignal, &mSignalLock);
+    } else if ((now = uv_hrtime()) < deadline) {
+      uv_cond_timedwait(&mSignal, &mSignalLock, deadline - now);
+    } else {
+      break;
+    }
+  }
+
+  OPA_store_int(&mWaiting, 0);
+  mWoken = false;
+
+  uv_mutex_unlock(&mSignalLock);
+
+  return count() > 0;
+}
+
+void EventQueue::wake() {
+  uv_mutex_lock(&mSignalLock);
+  mWoken = true;
+  uv_cond_signal(&mSignal);
+  uv_mutex_unlock(&mSignalLock);
 }
@@ -0,0 +1,219 @@
+#include "../includes/Quiescence.h"
+
+#include <algorithm>
+#include <iterator>
+
+// A quiet period is measured in QUIESCENCE_TICKS ticks, and the wheel has room for a whole period plus rounding, so
+// every path it holds is due within one turn of it
+#define QUIESCENCE_TICKS 64
+#define QUIESCENCE_SLOTS 128
+
+#pragma unmanaged
+Quiescence::Quiescence(uint32_t quietMS):
+  mHeldBytes(0),
+  mHeldEvents(0),
+  mQuietTicks(0),
+  mSlots(QUIESCENCE_SLOTS, NULL),
+  mTick(0),
+  mTickMS(std::max<uint32_t>((quietMS + QUIESCENCE_TICKS - 1) / QUIESCENCE_TICKS, 1)) {
+  mQuietTicks = (quietMS + mTickMS - 1) / mTickMS;
+}
+
+Quiescence::~Quiescence() {
+  std::vector<Event *> held;
+  releaseAll(held);
+  for (auto event = held.begin(); event != held.end(); ++event) {
+    delete *event;
+  }
+}
+
+bool Quiescence::empty() const {
+  return mPaths.empty() && mSettled.empty();
+}
+
+void Quiescence::hold(std::vector<Event *> &events, uint64_t now) {
+  advance(now);
+
+  for (auto i = events.begin(); i != events.end(); ++i) {
+    Event *event = *i;
+    ++mHeldEvents;
+    mHeldBytes += EventQueue::eventSize(event);
+
+    if (event->type == OVERFLOWED) {
+      std::vector<Event *> ahead;
+      takeAll(ahead);
+      mSettled.swap(ahead);
+      if (!mSettled.empty() && mSettled.back()->type == OVERFLOWED) {
+        // a queue that keeps overflowing while JS holds off would otherwise stack up overflows here
+        --mHeldEvents;
+        mHeldBytes -= EventQueue::eventSize(event);
+        delete event;
+      } else {
+        mSettled.push_back(event);
+      }
+      continue;
+    }
+
+    Path *path;
+    if (event->type == RENAMED) {
+      // the events still held under the old name travel with the file
+      std::string source = event->keyA();
+      std::string target = event->keyB();
+      auto found = mPaths.find(source);
+      Path *old = NULL;
+      if (source != target && found != mPaths.end()) {
+        old = found->second;
+        mPaths.erase(found);
+        unlink(old);
+      }
+
+      path = reset(target);
+      if (old != NULL) {
+        std::vector<Event *> merged;
+        merged.reserve(old->events.size() + path->events.size());
+        std::merge(
+          old->events.begin(), old->events.end(),
+          path->events.begin(), path->events.end(),
+          std::back_inserter(merged),
+          [](const Event *a, const Event *b) { return a->arrived < b->arrived; }
+        );
+        path->events.swap(merged);
+        path->deadline = std::max(path->deadline, old->deadline);
+        delete old;
+      }
+    } else {
+      path = reset(event->keyA());
+    }
+
+    // events that waited in the queue have already been quiet for a while, but a path can only go on a slot ahead
+    path->events.push_back(event);
+    uint64_t deadline = event->arrived / 1000000 / mTickMS + mQuietTicks + 1;
+    path->deadline = std::max(std::max(path->deadline, deadline), mTick + 1);
+    link(path);
+  }
+
+  events.clear();
+}
+
+uint64_t Quiescence::nextRelease() const {
+  if (!mSettled.empty()) {
+    return mTick * mTickMS;
+  }
+  if (mPaths.empty()) {
+    return UINT64_MAX;
+  }
+
+  for (uint64_t tick = mTick + 1; tick <= mTick + QUIESCENCE_SLOTS; ++tick) {
+    if (mSlots[tick % QUIESCENCE_SLOTS] != NULL) {
+      return tick * mTickMS;
+    }
+  }
+  return (mTick + 1) * mTickMS;
+}
+
+void Quiescence::release(uint64_t now, std::vector<Event *> &released) {
+  advance(now);
+  size_t from = released.size();
+  released.insert(released.end(), mSettled.begin(), mSettled.end());
+  mSettled.clear();
+  forget(released, from);
+}
+
+// Releases everything held, soonest due first
+void Quiescence::releaseAll(std::vector<Event *> &released) {
+  size_t from = released.size();
+  takeAll(released);
+  forget(released, from);
+}
+
+// Settles every path due by now. The wheel is a whole period wide, so a long gap between calls never needs more than
+// one turn of it.
+void Quiescence::advance(uint64_t now) {
+  uint64_t tick = now / mTickMS;
+  if (tick <= mTick) {
+    return;
+  }
+
+  uint64_t steps = std::min<uint64_t>(tick - mTick, QUIESCENCE_SLOTS);
+  for (uint64_t step = 1; step <= steps; ++step) {
+    Path *&slot = mSlots[(mTick + step) % QUIESCENCE_SLOTS];
+    while (slot != NULL && slot->deadline <= tick) {
+      settle(slot);
+    }
+  }
+  mTick = tick;
+}
+
+// Takes the events from the given index on out of the held counts, once they have been released
+void Quiescence::forget(const std::vector<Event *> &events, size_t from) {
+  for (size_t i = from; i < events.size(); ++i) {
+    --mHeldEvents;
+    mHeldBytes -= EventQueue::eventSize(events[i]);
+  }
+}
+
+// Slots are circular lists, so a path goes in at the back of its slot and paths due on the same tick settle in the
+// order they were last reset
+void Quiescence::link(Path *path) {
+  Path *&head = mSlots[path->deadline % QUIESCENCE_SLOTS];
+  if (head == NULL) {
+    head = path->previous = path->next = path;
+  } else {
+    path->previous = head->previous;
+    path->next = head;
+    head->previous->next = path;
+    head->previous = path;
+  }
+}
+
+// Takes a held path off the wheel to be reset, or starts holding a new one
+Quiescence::Path *Quiescence::reset(const std::string &name) {
+  auto found = mPaths.find(name);
+  if (found != mPaths.end()) {
+    unlink(found->second);
+    return found->second;
+  }
+
+  Path *path = new Path;
+  path->key = name;
+  path->deadline = 0;
+  mPaths[name] = path;
+  return path;
+}
+
+void Quiescence::settle(Path *path) {
+  unlink(path);
+  mPaths.erase(path->key);
+  mSettled.insert(mSettled.end(), path->events.begin(), path->events.end());
+  delete path;
+}
+
+// Moves everything held into events without counting it as released, soonest due first
+void Quiescence::takeAll(std::vector<Event *> &events) {
+  events.insert(events.end(), mSettled.begin(), mSettled.end());
+  mSettled.clear();
+
+  for (uint64_t tick = mTick + 1; !mPaths.empty() && tick <= mTick + QUIESCENCE_SLOTS; ++tick) {
+    Path *&slot = mSlots[tick % QUIESCENCE_SLOTS];
+    while (slot != NULL) {
+      Path *path = slot;
+      unlink(path);
+      mPaths.erase(path->key);
+      events.insert(events.end(), path->events.begin(), path->events.end());
+      delete path;
+    }
+  }
+}
+
+void Quiescence::unlink(Path *path) {
+  Path *&head = mSlots[path->deadline % QUIESCENCE_SLOTS];
+  if (path->next == path) {
+    head = NULL;
+  } else {
+    path->previous->next = path->next;
+    path->next->previous = path->previous;
+    if (head == path) {
+      head = path->next;
+    }
+  }
+}
@@ -42,9 +42,9 @@ void InotifyEventLoop::work() {
     }
 
     if (isDirectoryEvent) {
-      inotifyService->createDirectory(event->wd, strdup(event->name));
+      inotifyService->createDirectory(event->wd, event->name);
     } else {
-      inotifyService->create(event->wd, strdup(event->name));
+      inotifyService->create(event->wd, event->name);
     }
   };
 
@@ -53,7 +53,7 @@ void InotifyEventLoop::work() {
       return;
     }
 
-    inotifyService->modify(event->wd, strdup(event->name));
+    inotifyService->modify(event->wd, event->name);
   };
 
   auto remove = [&event, &isDirectoryRemoval, &inotifyService]() {
@@ -64,14 +64,15 @@ void InotifyEventLoop::work() {
     if (isDirectoryRemoval) {
       inotifyService->removeDirectory(event->wd);
     } else {
-      inotifyService->remove(event->wd, strdup(event->name));
+      inotifyService->remove(event->wd, event->name);
     }
   };
 
   auto renameStart = [&event, &isDirectoryEvent, &renameEvent]() {
     renameEvent.cookie = event->cookie;
     renameEvent.isDirectory = isDirectoryEvent;
-    renameEvent.name = event->name;
+    strncpy(renameEvent.name, event->name, NAME_MAX);
+    renameEvent.name[NAME_MAX] = '\0';
     renameEvent.wd = event->wd;
     renameEvent.isGood = true;
   };
@@ -115,7 +116,7 @@ void InotifyEventLoop::work() {
         continue;
       }
 
-      if (event->mask & (uint32_t)(IN_ATTRIB | IN_MODIFY)) {
+      if (event->mask & (uint32_t)(IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE)) {
         modify();
       } else if (event->mask & (uint32_t)IN_CREATE) {
         create();
@@ -136,13 +137,14 @@ void InotifyEventLoop::work() {
 
         renameStart();
       } else if (event->mask & (uint32_t)IN_MOVE_SELF) {
-        inotifyService->remove(event->wd, strdup(event->name));
+        inotifyService->remove(event->wd, event->name);
         inotifyService->removeDirectory(event->wd);
       }
     } while((position += sizeof(struct inotify_event) + event->len) < bytesRead);
     position = 0;
   }
   mStarted = false;
+  mInotifyService->mQueue.interrupt();
 }
 
 InotifyEventLoop::~InotifyEventLoop() {
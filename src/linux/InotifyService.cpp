@@ -1,6 +1,6 @@
 #include "../../includes/linux/InotifyService.h"
 
-InotifyService::InotifyService(EventQueue &queue, std::string path):
+InotifyService::InotifyService(EventQueue &queue, std::string path, WatchOptions options):
   mEventLoop(NULL),
   mQueue(queue),
   mTree(NULL) {
@@ -10,7 +10,7 @@ InotifyService::InotifyService(EventQueue &queue, std::string path):
     return;
   }
 
-  mTree = new InotifyTree(mInotifyInstance, path);
+  mTree = new InotifyTree(mInotifyInstance, path, options);
   if (!mTree->isRootAlive()) {
     delete mTree;
     mTree = NULL;
@@ -35,12 +35,13 @@ InotifyService::~InotifyService() {
   close(mInotifyInstance);
 }
 
-void InotifyService::create(int wd, std::string name) {
+void InotifyService::create(int wd, StringView name) {
   dispatch(CREATED, wd, name);
 }
 
-void InotifyService::dispatch(EventType action, int wd, std::string name) {
-  std::string path;
+// The name is only borrowed from the inotify buffer, the event copies it exactly once
+void InotifyService::dispatch(EventType action, int wd, StringView name) {
+  PathHandle path;
   if (!mTree->getPath(path, wd)) {
     return;
   }
@@ -48,8 +49,8 @@ void InotifyService::dispatch(EventType action, int wd, std::string name) {
   mQueue.enqueue(action, path, name);
 }
 
-void InotifyService::dispatchRename(int wd, std::string oldName, std::string newName) {
-  std::string path;
+void InotifyService::dispatchRename(int wd, StringView oldName, StringView newName) {
+  PathHandle path;
   if (!mTree->getPath(path, wd)) {
     return;
   }
@@ -81,37 +82,49 @@ bool InotifyService::isWatching() {
   return mTree->isRootAlive() && mEventLoop->isLooping();
 }
 
-void InotifyService::modify(int wd, std::string name) {
+void InotifyService::modify(int wd, StringView name) {
   dispatch(MODIFIED, wd, name);
 }
 
-void InotifyService::remove(int wd, std::string name) {
+void InotifyService::remove(int wd, StringView name) {
   dispatch(DELETED, wd, name);
 }
 
-void InotifyService::rename(int wd, std::string oldName, std::string newName) {
+void InotifyService::rename(int wd, StringView oldName, StringView newName) {
   dispatchRename(wd, oldName, newName);
 }
 
-void InotifyService::createDirectory(int wd, std::string name) {
+void InotifyService::createDirectory(int wd, StringView name) {
   if (!mTree->nodeExists(wd)) {
     return;
   }
 
-  mTree->addDirectory(wd, name);
+  mTree->addDirectory(wd, std::string(name.data, name.length));
   dispatch(CREATED, wd, name);
+
+  if (mTree->hasErrored()) {
+    mQueue.interrupt();
+  }
 }
 
 void InotifyService::removeDirectory(int wd) {
   mTree->removeDirectory(wd);
+
+  if (!mTree->isRootAlive()) {
+    mQueue.interrupt();
+  }
 }
 
-void InotifyService::renameDirectory(int wd, std::string oldName, std::string newName) {
+void InotifyService::renameDirectory(int wd, StringView oldName, StringView newName) {
   if (!mTree->nodeExists(wd)) {
     return;
   }
 
-  mTree->renameDirectory(wd, oldName, newName);
+  mTree->renameDirectory(
+    wd,
+    std::string(oldName.data, oldName.length),
+    std::string(newName.data, newName.length)
+  );
 
   dispatchRename(wd, oldName, newName);
 }
@@ -2,9 +2,10 @@
 /**
  * InotifyTree ---------------------------------------------------------------------------------------------------------
  */
-InotifyTree::InotifyTree(int inotifyInstance, std::string path):
+InotifyTree::InotifyTree(int inotifyInstance, std::string path, WatchOptions options):
   mError(""),
-  mInotifyInstance(inotifyInstance) {
+  mInotifyInstance(inotifyInstance),
+  mWatchMask(watchMask(options)) {
   mInotifyNodeByWatchDescriptor = new std::map<int, InotifyNode *>;
 
   std::string directory;
@@ -36,7 +37,7 @@ InotifyTree::InotifyTree(int inotifyInstance, std::string path):
   }
 }
 
-void InotifyTree::addDirectory(int wd, std::string name) {
+void InotifyTree::addDirectory(int wd, const std::string &name) {
   auto nodeIterator = mInotifyNodeByWatchDescriptor->find(wd);
   if (nodeIterator == mInotifyNodeByWatchDescriptor->end()) {
     return;
@@ -54,7 +55,7 @@ std::string InotifyTree::getError() {
   return mError;
 }
 
-bool InotifyTree::getPath(std::string &out, int wd) {
+bool InotifyTree::getPath(PathHandle &out, int wd) {
   auto nodeIterator = mInotifyNodeByWatchDescriptor->find(wd);
   if (nodeIterator == mInotifyNodeByWatchDescriptor->end()) {
     return false;
@@ -101,7 +102,7 @@ void InotifyTree::removeNodeReferenceByWD(int wd) {
   }
 }
 
-void InotifyTree::renameDirectory(int wd, std::string oldName, std::string newName) {
+void InotifyTree::renameDirectory(int wd, const std::string &oldName, const std::string &newName) {
   auto nodeIterator = mInotifyNodeByWatchDescriptor->find(wd);
   if (nodeIterator == mInotifyNodeByWatchDescriptor->end()) {
     return;
@@ -110,6 +111,20 @@ void InotifyTree::renameDirectory(int wd, std::string oldName, std::string newNa
   nodeIterator->second->renameChild(oldName, newName);
 }
 
+// Creations and moves are always watched, since they are how the tree learns of the directories below it, and a
+// directory's own watch reports its deletion. The rest is left to the kernel to drop when nobody wants it.
+// IN_CLOSE_WRITE fires once per writer closing the file, where IN_MODIFY fires on every write().
+uint32_t InotifyTree::watchMask(WatchOptions options) {
+  uint32_t mask = IN_CREATE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF;
+  if (options.actions & (1 << DELETED)) {
+    mask |= IN_DELETE;
+  }
+  if (options.actions & (1 << MODIFIED)) {
+    mask |= IN_ATTRIB | (options.closeWrite ? IN_CLOSE_WRITE : IN_MODIFY);
+  }
+  return mask;
+}
+
 void InotifyTree::setError(std::string error) {
   mError = error;
 }
@@ -118,6 +133,7 @@ InotifyTree::~InotifyTree() {
   if (isRootAlive()) {
     delete mRoot;
   }
+  delete mInotifyNodeByWatchDescriptor;
 }
 
 /**
@@ -136,13 +152,13 @@ InotifyTree::InotifyNode::InotifyNode(
   mParent(parent),
   mTree(tree) {
   mChildren = new std::map<std::string, InotifyNode *>;
-  mFullPath = createFullPath(mDirectory, mName);
+  mFullPath = std::make_shared<const std::string>(createFullPath(mDirectory, mName));
   mWatchDescriptorInitialized = false;
 
   dirent ** directoryContents = NULL;
 
   int resultCountOrError = scandir(
-    mFullPath.c_str(),
+    mFullPath->c_str(),
     &directoryContents,
     NULL,
     alphasort
@@ -164,7 +180,7 @@ InotifyTree::InotifyNode::InotifyNode(
       continue;
     }
 
-    std::string filePath = createFullPath(mFullPath, fileName);
+    std::string filePath = createFullPath(*mFullPath, fileName);
 
     struct stat file;
 
@@ -179,7 +195,7 @@ InotifyTree::InotifyNode::InotifyNode(
       mTree,
       mInotifyInstance,
       this,
-      mFullPath,
+      *mFullPath,
       fileName
     );
 
@@ -190,11 +206,12 @@ InotifyTree::InotifyNode::InotifyNode(
     }
   }
 
+  // scandir allocates with malloc
   for (int i = 0; i < resultCountOrError; ++i) {
-    delete directoryContents[i];
+    free(directoryContents[i]);
   }
 
-  delete[] directoryContents;
+  free(directoryContents);
 }
 
 InotifyTree::InotifyNode::~InotifyNode() {
@@ -210,12 +227,12 @@ InotifyTree::InotifyNode::~InotifyNode() {
   delete mChildren;
 }
 
-void InotifyTree::InotifyNode::addChild(std::string name) {
+void InotifyTree::InotifyNode::addChild(const std::string &name) {
   InotifyNode *child = new InotifyNode(
     mTree,
     mInotifyInstance,
     this,
-    mFullPath,
+    *mFullPath,
     name
   );
 
@@ -229,23 +246,24 @@ void InotifyTree::InotifyNode::addChild(std::string name) {
   }
 }
 
+// Events already queued keep the path they were created with, the node moves on to a fresh one
 void InotifyTree::InotifyNode::fixPaths() {
-  std::string parentPath = mParent->getFullPath();
+  std::string parentPath = *mParent->getFullPath();
   std::string fullPath = createFullPath(parentPath, mName);
 
-  if (fullPath == mFullPath) {
+  if (fullPath == *mFullPath) {
     return;
   }
 
   mDirectory = parentPath;
-  mFullPath = fullPath;
+  mFullPath = std::make_shared<const std::string>(fullPath);
 
   for(auto i = mChildren->begin(); i != mChildren->end(); ++i) {
     i->second->fixPaths();
   }
 }
 
-std::string InotifyTree::InotifyNode::getFullPath() {
+PathHandle InotifyTree::InotifyNode::getFullPath() {
   return mFullPath;
 }
 
@@ -267,13 +285,13 @@ bool InotifyTree::InotifyNode::inotifyInit() {
     return false;
   }
 
-  int attr = mParent != NULL
-           ? ATTRIBUTES
-           : ATTRIBUTES | IN_MOVE_SELF;
+  uint32_t attr = mParent != NULL
+                ? mTree->mWatchMask
+                : mTree->mWatchMask | IN_MOVE_SELF;
 
   mWatchDescriptor = inotify_add_watch(
     mInotifyInstance,
-    mFullPath.c_str(),
+    mFullPath->c_str(),
     attr
   );
 
@@ -302,7 +320,7 @@ bool InotifyTree::InotifyNode::inotifyInit() {
     struct stat file;
 
     if (
-      stat(mFullPath.c_str(), &file) < 0 ||
+      stat(mFullPath->c_str(), &file) < 0 ||
       !S_ISDIR(file.st_mode)
     ) {
       mAlive = false;
@@ -322,7 +340,7 @@ bool InotifyTree::InotifyNode::inotifyInit() {
   return mAlive;
 }
 
-void InotifyTree::InotifyNode::removeChild(std::string name) {
+void InotifyTree::InotifyNode::removeChild(const std::string &name) {
   auto child = mChildren->find(name);
   if (child != mChildren->end()) {
     delete child->second;
@@ -331,7 +349,7 @@ void InotifyTree::InotifyNode::removeChild(std::string name) {
   }
 }
 
-void InotifyTree::InotifyNode::renameChild(std::string oldName, std::string newName) {
+void InotifyTree::InotifyNode::renameChild(const std::string &oldName, const std::string &newName) {
   auto child = mChildren->find(oldName);
   if (child == mChildren->end()) {
     child = mChildren->find(newName);
@@ -347,7 +365,7 @@ void InotifyTree::InotifyNode::renameChild(std::string oldName, std::string newN
   (*mChildren)[newName] = node;
 }
 
-void InotifyTree::InotifyNode::setName(std::string name) {
+void InotifyTree::InotifyNode::setName(const std::string &name) {
   mName = name;
   fixPaths();
 }
@@ -1,7 +1,7 @@
 #include "../../includes/osx/FSEventsService.h"
 #include <iostream>
 
-FSEventsService::FSEventsService(EventQueue &queue, std::string path):
+FSEventsService::FSEventsService(EventQueue &queue, std::string path, WatchOptions options):
   mPath(path), mQueue(queue) {
   mRunLoop = new RunLoop(this, path);
 
@@ -1,6 +1,6 @@
 #include "../../includes/win32/ReadLoop.h"
 
-ReadLoop::ReadLoop(EventQueue &queue, std::string path):
+ReadLoop::ReadLoop(EventQueue &queue, std::string path, WatchOptions options):
   mDirectoryHandle(NULL),
   mQueue(queue),
   mRunner(NULL),
@@ -218,6 +218,7 @@ void ReadLoopRunner::resizeBuffers(unsigned int bufferSize) {
 
 void ReadLoopRunner::setError(std::string error) {
   mErrorMessage = error;
+  mQueue.interrupt();
 }
 
 void ReadLoopRunner::setSharedPointer(std::shared_ptr<ReadLoopRunner> *ptr) {
@@ -0,0 +1,182 @@
+// Counts the heap allocations an inotify event costs on its way from the read buffer into the EventQueue. Hand built
+// inotify_event records go through a pipe into an InotifyEventLoop, which hands them to InotifyService::dispatch and
+// dispatchRename like any other read. Once the event pool and the ring have seen a round of events, a create, modify,
+// rename and delete of a file must not touch the heap at all. Every malloc is counted, which covers operator new, so
+// a copy of a name or of the directory path fails the test.
+//
+// Paths and names are longer than std::string keeps inline, so that a copy of either has to allocate.
+//
+// Build and run from the repository root on Linux with glibc:
+//   gcc -O2 -DOPA_HAVE_GCC_INTRINSIC_ATOMICS=1 -DHAVE_STDDEF_H=1 -Iopenpa/src
+//     -c openpa/src/opa_queue.c openpa/src/opa_primitives.c
+//   g++ -std=c++11 -O2 -DOPA_HAVE_GCC_INTRINSIC_ATOMICS=1 -DHAVE_STDDEF_H=1 -Iopenpa/src -Iincludes
+//     test/allocations.cpp src/Queue.cpp src/Pool.cpp src/Lock.cpp src/linux/*.cpp
+//     opa_queue.o opa_primitives.o -luv -lpthread -o allocations-test
+//   ./allocations-test
+#include "Queue.h"
+#include "linux/InotifyEventLoop.h"
+#include "linux/InotifyService.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <vector>
+
+#define FILES_PER_ROUND 200 // each file is created, modified, renamed and deleted, 4 events from 5 records
+#define EVENTS_PER_ROUND (FILES_PER_ROUND * 4)
+#define WARM_ROUNDS 2 // enough for the ring to cross a segment and keep the drained one as its spare
+#define MEASURED_ROUNDS 2
+#define RECORD_SIZE 64 // divides the pipe's atomic write size and the loop's read buffer, so no read splits a record
+#define RECORDS_PER_WRITE (PIPE_BUF / RECORD_SIZE)
+
+// glibc routes its own calls through an interposed malloc as well, strdup included
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *memory, size_t size);
+
+static std::atomic<bool> sCounting(false);
+static std::atomic<int> sAllocations(0);
+
+extern "C" void *malloc(size_t size) {
+  if (sCounting.load(std::memory_order_relaxed)) {
+    sAllocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+  if (sCounting.load(std::memory_order_relaxed)) {
+    sAllocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *memory, size_t size) {
+  if (sCounting.load(std::memory_order_relaxed)) {
+    sAllocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  return __libc_realloc(memory, size);
+}
+
+static void appendRecord(std::vector<char> &records, int wd, uint32_t mask, uint32_t cookie, const char *name) {
+  size_t start = records.size();
+  records.resize(start + RECORD_SIZE, '\0');
+  inotify_event *event = reinterpret_cast<inotify_event *>(&records[start]);
+  event->wd = wd;
+  event->mask = mask;
+  event->cookie = cookie;
+  event->len = RECORD_SIZE - sizeof(inotify_event);
+  strncpy(event->name, name, event->len - 1);
+}
+
+// The records for one round, in the order inotify reports them
+static std::vector<char> buildRound(int wd, int round) {
+  std::vector<char> records;
+  char name[RECORD_SIZE], renamed[RECORD_SIZE];
+  for (int i = 0; i < FILES_PER_ROUND; ++i) {
+    uint32_t cookie = (uint32_t)(round * FILES_PER_ROUND + i + 1);
+    snprintf(name, sizeof(name), "allocation-test-file-%d-%d", round, i);
+    snprintf(renamed, sizeof(renamed), "allocation-test-renamed-%d-%d", round, i);
+    appendRecord(records, wd, IN_CREATE, 0, name);
+    appendRecord(records, wd, IN_MODIFY, 0, name);
+    appendRecord(records, wd, IN_MOVED_FROM, cookie, name);
+    appendRecord(records, wd, IN_MOVED_TO, cookie, renamed);
+    appendRecord(records, wd, IN_DELETE, 0, renamed);
+  }
+  return records;
+}
+
+static bool feed(int fd, const std::vector<char> &records) {
+  for (size_t offset = 0; offset < records.size(); offset += RECORDS_PER_WRITE * RECORD_SIZE) {
+    size_t length = records.size() - offset;
+    if (length > RECORDS_PER_WRITE * RECORD_SIZE) {
+      length = RECORDS_PER_WRITE * RECORD_SIZE;
+    }
+    if (write(fd, &records[offset], length) != (ssize_t)length) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Spins rather than sleeping on a condition, so that the waiting thread allocates nothing itself
+static bool waitForEvents(EventQueue &queue, int count) {
+  for (int i = 0; i < 5000 && queue.count() < count; ++i) {
+    usleep(1000);
+  }
+  return queue.count() == count;
+}
+
+int main() {
+  char directory[] = "/tmp/nsfw-allocation-test-XXXXXX";
+  if (mkdtemp(directory) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  int pipeFds[2];
+  if (pipe(pipeFds) != 0) {
+    perror("pipe");
+    return 1;
+  }
+
+  QueueCapacity capacity = { 0, 0, COLLAPSE_TO_OVERFLOW };
+  WatchOptions options = { false, ALL_ACTIONS };
+  EventQueue queue(directory, capacity, false, ALL_ACTIONS);
+  int failures = 0;
+
+  {
+    // the service watches the empty directory for real, which gives its tree the watch descriptor our records use.
+    // The root is the first watch on a fresh inotify instance.
+    InotifyService service(queue, directory, options);
+    InotifyEventLoop loop(pipeFds[0], &service);
+    std::vector<Event *> events;
+
+    for (int round = 0; round < WARM_ROUNDS + MEASURED_ROUNDS; ++round) {
+      std::vector<char> records = buildRound(1, round);
+      bool measured = round >= WARM_ROUNDS;
+
+      sAllocations.store(0);
+      sCounting.store(measured);
+      bool fed = feed(pipeFds[1], records);
+      bool arrived = fed && waitForEvents(queue, EVENTS_PER_ROUND);
+      sCounting.store(false);
+
+      if (!arrived) {
+        printf("round %d: %d of %d events arrived\n", round, queue.count(), EVENTS_PER_ROUND);
+        ++failures;
+        break;
+      }
+
+      if (measured) {
+        int allocations = sAllocations.load();
+        printf(
+          "round %d: %d allocations for %d events, %.3f per event\n",
+          round,
+          allocations,
+          EVENTS_PER_ROUND,
+          (double)allocations / EVENTS_PER_ROUND
+        );
+        if (allocations != 0) {
+          ++failures;
+        }
+      }
+
+      events.clear();
+      queue.dequeueAll(events);
+      for (auto event = events.begin(); event != events.end(); ++event) {
+        delete *event;
+      }
+    }
+  }
+
+  close(pipeFds[0]);
+  close(pipeFds[1]);
+  rmdir(directory);
+
+  printf(failures == 0 ? "ok\n" : "FAILED\n");
+  return failures == 0 ? 0 : 1;
+}